@@ -3,9 +3,21 @@
 
 #include "graph.h"
 #include "lib/graphics.c"
+#include "parallel.h"
 #include <math.h>
 #include <stdio.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Build with -DPRINT_ENGINE_STATS=1 to print what every path query did.
+// Queries rerun as the graph changes, so this is off by default, and
+// bench.c reports the same counters.
+#ifndef PRINT_ENGINE_STATS
+#define PRINT_ENGINE_STATS 0
+#endif
+
 f64 get_distance(f64 x0, f64 y0, f64 x1, f64 y1) {
   f64 dx = x1 - x0;
   f64 dy = y1 - y0;
@@ -13,154 +25,3736 @@ f64 get_distance(f64 x0, f64 y0, f64 x1, f64 y1) {
 }
 
 void clear_node_edge_highlight(Graph *graph) {
-  for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-    graph->nodes[i].highlight = 0;
-    graph->nodes[i].distance = -1;
-  }
+  for (i64 i = 0; i < bitset_words(graph->num_nodes); ++i)
+    graph->node_highlight[i] = 0;
 
-  for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-    graph->edges[i].highlight = 0;
-  }
+  for (i64 i = 0; i < bitset_words(graph->num_edges); ++i)
+    graph->edge_highlight[i] = 0;
 }
 
 b8 validate_node(Graph *graph, i64 node_idx) {
-  return (node_idx >= 0) && (node_idx < MAX_NUM_NODES) &&
-         graph->nodes[node_idx].enabled;
+  return (node_idx >= 0) && (node_idx < graph->num_nodes) &&
+         bit_get(graph->node_enabled, node_idx);
 }
 
 b8 validate_edge(Graph *graph, i64 edge_idx) {
-  return (edge_idx >= 0) && (edge_idx < MAX_NUM_EDGES) &&
-         graph->edges[edge_idx].enabled &&
-         validate_node(graph, graph->edges[edge_idx].src) &&
-         validate_node(graph, graph->edges[edge_idx].dst);
+  return (edge_idx >= 0) && (edge_idx < graph->num_edges) &&
+         bit_get(graph->edge_enabled, edge_idx) &&
+         validate_node(graph, graph->edge_src[edge_idx]) &&
+         validate_node(graph, graph->edge_dst[edge_idx]);
 }
 
-void highlight_path(Graph *graph, i64 src, i64 dst) {
-  clear_node_edge_highlight(graph);
+// Indexed binary min-heap of node indices keyed by tentative distance.
+// slots[node] is the heap position of the node plus one, 0 if absent.
+typedef struct {
+  i64 capacity;
+  i64 size;
+  i64 *nodes;
+  f64 *keys;
+  i64 *slots;
+} Heap;
 
-  if (!validate_node(graph, src) || !validate_node(graph, dst)) {
-    printf("Invalid source or destination node index.\n");
+void heap_reserve(Heap *heap, i64 capacity) {
+  if (capacity <= heap->capacity)
     return;
-  }
 
-  // Set initial conditions
-  graph->nodes[src].highlight = 1;
-  graph->nodes[dst].highlight = 1;
-  graph->nodes[src].distance = 0;
+  heap->nodes = resize_array(heap->nodes, heap->capacity, capacity, sizeof(i64));
+  heap->keys = resize_array(heap->keys, heap->capacity, capacity, sizeof(f64));
+  heap->slots = resize_array(heap->slots, heap->capacity, capacity, sizeof(i64));
+  heap->capacity = capacity;
+}
+
+void heap_swap(Heap *heap, i64 a, i64 b) {
+  i64 na = heap->nodes[a];
+  i64 nb = heap->nodes[b];
+  f64 ka = heap->keys[a];
+
+  heap->nodes[a] = nb;
+  heap->keys[a] = heap->keys[b];
+  heap->nodes[b] = na;
+  heap->keys[b] = ka;
+
+  heap->slots[nb] = a + 1;
+  heap->slots[na] = b + 1;
+}
 
-  // Finding the shortest path using a distance-driven search
+void heap_sift_up(Heap *heap, i64 i) {
+  while (i > 0) {
+    i64 parent = (i - 1) / 2;
+    if (heap->keys[parent] <= heap->keys[i])
+      break;
+    heap_swap(heap, i, parent);
+    i = parent;
+  }
+}
+
+void heap_sift_down(Heap *heap, i64 i) {
   for (;;) {
-    i64 nearest_node_idx = -1;
-    f64 nearest_dist = -1;
+    i64 left = 2 * i + 1;
+    i64 right = left + 1;
+    i64 smallest = i;
 
-    // Evaluate all edges to find the nearest unvisited node
-    for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-      if (!validate_edge(graph, i))
-        continue;
+    if (left < heap->size && heap->keys[left] < heap->keys[smallest])
+      smallest = left;
+    if (right < heap->size && heap->keys[right] < heap->keys[smallest])
+      smallest = right;
+    if (smallest == i)
+      break;
+
+    heap_swap(heap, i, smallest);
+    i = smallest;
+  }
+}
 
-      Edge edge = graph->edges[i];
-      Node node0 = graph->nodes[edge.src];
-      Node node1 = graph->nodes[edge.dst];
-      f64 length = get_distance(node0.x, node0.y, node1.x, node1.y);
+b8 heap_contains(Heap *heap, i64 node) { return heap->slots[node] != 0; }
 
-      // Look for unvisited nodes on both ends of the edge
-      if (node0.distance >= 0 && node1.distance < 0) {
-        if (nearest_node_idx < 0 || node0.distance + length < nearest_dist) {
-          nearest_node_idx = edge.dst;
-          nearest_dist = node0.distance + length;
-        }
-      }
-      if (node1.distance >= 0 && node0.distance < 0) {
-        if (nearest_node_idx < 0 || node1.distance + length < nearest_dist) {
-          nearest_node_idx = edge.src;
-          nearest_dist = node1.distance + length;
-        }
-      }
+// Insert the node, or lower its key if it is already in the heap.
+void heap_push(Heap *heap, i64 node, f64 key) {
+  if (heap_contains(heap, node)) {
+    i64 i = heap->slots[node] - 1;
+    if (key < heap->keys[i]) {
+      heap->keys[i] = key;
+      heap_sift_up(heap, i);
+    }
+    return;
+  }
+
+  assert(node < heap->capacity);
+
+  i64 i = heap->size++;
+  heap->nodes[i] = node;
+  heap->keys[i] = key;
+  heap->slots[node] = i + 1;
+  heap_sift_up(heap, i);
+}
+
+// Insert the node or move it to the new key, up or down.
+void heap_update(Heap *heap, i64 node, f64 key) {
+  if (!heap_contains(heap, node)) {
+    heap_push(heap, node, key);
+    return;
+  }
+
+  i64 i = heap->slots[node] - 1;
+  heap->keys[i] = key;
+  heap_sift_up(heap, i);
+  heap_sift_down(heap, heap->slots[node] - 1);
+}
+
+i64 heap_pop(Heap *heap, f64 *key) {
+  assert(heap->size > 0);
+
+  i64 node = heap->nodes[0];
+  *key = heap->keys[0];
+
+  heap_swap(heap, 0, heap->size - 1);
+  heap->size--;
+  heap->slots[node] = 0;
+  heap_sift_down(heap, 0);
+
+  return node;
+}
+
+void heap_clear(Heap *heap) {
+  for (i64 i = 0; i < heap->size; ++i)
+    heap->slots[heap->nodes[i]] = 0;
+  heap->size = 0;
+}
+
+// Growable list of node or edge indices.
+typedef struct {
+  i64 capacity;
+  i64 size;
+  i64 *items;
+} Index_List;
+
+void index_list_push(Index_List *list, i64 item) {
+  if (list->size == list->capacity) {
+    i64 capacity = list->capacity > 0 ? list->capacity * 2 : 4;
+    list->items = resize_array(list->items, list->capacity, capacity,
+                               sizeof(i64));
+    list->capacity = capacity;
+  }
+
+  list->items[list->size++] = item;
+}
+
+enum {
+  PATH_DIJKSTRA,
+  PATH_ASTAR,
+  PATH_BIDIRECTIONAL,
+  PATH_INCREMENTAL,
+  PATH_DELTA_STEPPING,
+  PATH_CONTRACTION,
+  PATH_LANDMARKS,
+  PATH_K_SHORTEST,
+  NUM_PATH_MODES,
+};
+
+c8 *path_mode_names[NUM_PATH_MODES] = {
+    [PATH_DIJKSTRA] = "Dijkstra",
+    [PATH_ASTAR] = "A*",
+    [PATH_BIDIRECTIONAL] = "Bidirectional",
+    [PATH_INCREMENTAL] = "Incremental",
+    [PATH_DELTA_STEPPING] = "Delta-stepping",
+    [PATH_CONTRACTION] = "Contraction hierarchy",
+    [PATH_LANDMARKS] = "ALT",
+    [PATH_K_SHORTEST] = "Yen's k shortest",
+};
+
+// Scratch state of the shortest path search, kept outside the graph.
+// distance is -1 for nodes that are not settled yet. The counters
+// describe the work done by the last query.
+typedef struct {
+  i64 capacity;
+  f64 *distance;
+  i64 *prev_edge;
+  Heap heap;
+
+  i64 nodes_expanded;
+  i64 edges_relaxed;
+} Path_Search;
+
+Path_Search path_search = {0};
+Path_Search path_search_reverse = {0};
+
+void path_search_reserve(Path_Search *search, i64 num_nodes) {
+  heap_reserve(&search->heap, num_nodes);
+
+  if (num_nodes <= search->capacity)
+    return;
+
+  search->distance = resize_array(search->distance, search->capacity,
+                                  num_nodes, sizeof(f64));
+  search->prev_edge = resize_array(search->prev_edge, search->capacity,
+                                   num_nodes, sizeof(i64));
+  search->capacity = num_nodes;
+}
+
+// Lower bound on the distance from the node to dst. Must never
+// overestimate and must be consistent, so that nodes are settled with
+// their final distance.
+typedef f64 Heuristic_Fn(void *data, i64 node_idx, i64 dst);
+
+// Straight-line distance, exact as a bound since edge lengths are
+// Euclidean. Not a bound on weights, so weighted graphs search without
+// it. data is the Graph_View.
+f64 euclidean_heuristic(void *data, i64 node_idx, i64 dst) {
+  Graph_View *view = data;
+
+  return get_distance(view->node_x[node_idx], view->node_y[node_idx],
+                      view->node_x[dst], view->node_y[dst]);
+}
+
+// Best-first search from src, stopping once dst is settled, or settling
+// every reachable node if dst is -1. Without a heuristic this is
+// Dijkstra's algorithm. With one, nodes are ordered by distance plus the
+// heuristic bound to dst (A*). Settled nodes get their final distance in
+// search->distance, and search->prev_edge holds the edge each node was
+// reached by. Only the search is written, so threads with their own
+// search can share the view.
+void search_path_view(Graph_View *view, Path_Search *search, i64 src, i64 dst,
+                      Heuristic_Fn *heuristic, void *heuristic_data) {
+  path_search_reserve(search, view->num_nodes);
+  heap_clear(&search->heap);
+
+  for (i64 i = 0; i < view->num_nodes; ++i)
+    search->distance[i] = -1;
+
+  search->nodes_expanded = 0;
+  search->edges_relaxed = 0;
+
+  search->prev_edge[src] = -1;
+  heap_push(&search->heap, src, 0);
+
+  while (search->heap.size > 0) {
+    f64 key;
+    i64 node_idx = heap_pop(&search->heap, &key);
+
+    // Recover the distance from the predecessor rather than the key, which
+    // includes the heuristic
+    f64 dist = 0;
+    i64 prev = search->prev_edge[node_idx];
+
+    if (prev >= 0) {
+      i64 from = view->edge_src[prev] == node_idx ? view->edge_dst[prev]
+                                                  : view->edge_src[prev];
+      dist = search->distance[from] + view->edge_cost[prev];
     }
 
-    // If no further nodes can be found, exit the loop
-    if (nearest_node_idx < 0)
+    search->distance[node_idx] = dist;
+    search->nodes_expanded++;
+
+    if (node_idx == dst)
       break;
 
-    graph->nodes[nearest_node_idx].distance = nearest_dist;
+    for (i64 k = view->offsets[node_idx]; k < view->offsets[node_idx + 1];
+         ++k) {
+      i64 edge_idx = view->edge_ids[k];
+      i64 next_idx = view->neighbors[k];
+
+      if (search->distance[next_idx] >= 0)
+        continue;
+
+      f64 next_key = dist + view->edge_cost[edge_idx];
+
+      if (heuristic != NULL)
+        next_key += heuristic(heuristic_data, next_idx, dst);
+
+      search->edges_relaxed++;
+
+      if (heap_contains(&search->heap, next_idx) &&
+          search->heap.keys[search->heap.slots[next_idx] - 1] <= next_key)
+        continue;
+
+      search->prev_edge[next_idx] = edge_idx;
+      heap_push(&search->heap, next_idx, next_key);
+    }
+  }
+
+  heap_clear(&search->heap);
+}
+
+void search_path(Graph *graph, Path_Search *search, i64 src, i64 dst,
+                 b8 heuristic) {
+  Graph_View view = get_graph_view(graph);
+  search_path_view(&view, search, src, dst,
+                   heuristic && !view.weighted ? euclidean_heuristic : NULL,
+                   &view);
+}
+
+void find_shortest_path(Graph *graph, Path_Search *search, i64 src, i64 dst) {
+  search_path(graph, search, src, dst, 0);
+}
+
+void find_shortest_path_astar(Graph *graph, Path_Search *search, i64 src,
+                              i64 dst) {
+  search_path(graph, search, src, dst, 1);
+}
+
+// Settled or tentative distance of the node in the search, -1 if it has
+// not been reached.
+f64 reached_distance(Path_Search *search, i64 node) {
+  if (search->distance[node] >= 0)
+    return search->distance[node];
+  if (heap_contains(&search->heap, node))
+    return search->heap.keys[search->heap.slots[node] - 1];
+  return -1;
+}
+
+// Settle the nearest node of one side of a bidirectional search and relax
+// its edges. Every relaxed edge leading to a node the other side has
+// reached is a candidate meeting point for the shortest path. The best
+// one so far is kept as best_edge, with meet being its endpoint on the
+// backward side.
+void bidirectional_step(Graph *graph, Path_Search *side, Path_Search *other,
+                        b8 reverse, f64 *best, i64 *best_edge, i64 *meet) {
+  Adjacency *adj = &graph->adjacency;
+
+  f64 dist;
+  i64 node_idx = heap_pop(&side->heap, &dist);
 
-    // Stop if we've reached the destination
-    if (nearest_node_idx == dst)
+  side->distance[node_idx] = dist;
+  side->nodes_expanded++;
+
+  for (i64 k = adj->offsets[node_idx]; k < adj->offsets[node_idx + 1]; ++k) {
+    i64 edge_idx = adj->edge_ids[k];
+    i64 next_idx = adj->neighbors[k];
+    f64 next_dist = dist + graph->edge_cost[edge_idx];
+
+    side->edges_relaxed++;
+
+    f64 rest = reached_distance(other, next_idx);
+    if (rest >= 0 && (*best_edge < 0 || next_dist + rest < *best)) {
+      *best = next_dist + rest;
+      *best_edge = edge_idx;
+      *meet = reverse ? node_idx : next_idx;
+    }
+
+    if (side->distance[next_idx] >= 0)
+      continue;
+
+    if (heap_contains(&side->heap, next_idx) &&
+        side->heap.keys[side->heap.slots[next_idx] - 1] <= next_dist)
+      continue;
+
+    side->prev_edge[next_idx] = edge_idx;
+    heap_push(&side->heap, next_idx, next_dist);
+  }
+}
+
+// Dijkstra's algorithm run from src in forward and from dst in reverse,
+// always advancing the side with the nearer frontier. It stops once the
+// two frontier distances add up to at least the best meeting point found,
+// as no path through unsettled nodes can be shorter. The backward half of
+// the path is then copied into forward's prev_edge, so forward reads like
+// the result of find_shortest_path.
+void find_shortest_path_bidirectional(Graph *graph, Path_Search *forward,
+                                      Path_Search *backward, i64 src,
+                                      i64 dst) {
+  get_adjacency(graph);
+  get_edge_costs(graph);
+  path_search_reserve(forward, graph->num_nodes);
+  path_search_reserve(backward, graph->num_nodes);
+  heap_clear(&forward->heap);
+  heap_clear(&backward->heap);
+
+  for (i64 i = 0; i < graph->num_nodes; ++i) {
+    forward->distance[i] = -1;
+    backward->distance[i] = -1;
+  }
+
+  forward->nodes_expanded = 0;
+  forward->edges_relaxed = 0;
+  backward->nodes_expanded = 0;
+  backward->edges_relaxed = 0;
+
+  forward->prev_edge[src] = -1;
+  backward->prev_edge[dst] = -1;
+
+  if (src == dst) {
+    forward->distance[src] = 0;
+    return;
+  }
+
+  heap_push(&forward->heap, src, 0);
+  heap_push(&backward->heap, dst, 0);
+
+  f64 best = 0;
+  i64 best_edge = -1;
+  i64 meet = -1;
+
+  while (forward->heap.size > 0 && backward->heap.size > 0) {
+    f64 top_forward = forward->heap.keys[0];
+    f64 top_backward = backward->heap.keys[0];
+
+    if (best_edge >= 0 && top_forward + top_backward >= best)
       break;
+
+    if (top_forward <= top_backward)
+      bidirectional_step(graph, forward, backward, 0, &best, &best_edge,
+                         &meet);
+    else
+      bidirectional_step(graph, backward, forward, 1, &best, &best_edge,
+                         &meet);
   }
 
-  // If no path was found, alert the user
-  if (graph->nodes[dst].distance < 0) {
-    printf("Path not found\n");
+  heap_clear(&forward->heap);
+  heap_clear(&backward->heap);
+
+  if (best_edge < 0)
     return;
+
+  forward->prev_edge[meet] = best_edge;
+
+  for (i64 curr = meet; curr != dst;) {
+    i64 edge_idx = backward->prev_edge[curr];
+    i64 next = graph->edge_src[edge_idx] == curr ? graph->edge_dst[edge_idx]
+                                                 : graph->edge_src[edge_idx];
+    forward->prev_edge[next] = edge_idx;
+    curr = next;
   }
 
-  // Backtrack from destination to reconstruct the path
-  i64 curr_node_idx = dst;
+  forward->distance[dst] = best;
+}
 
-  while (curr_node_idx != src) {
-    f64 dist = -1;
-    i64 next_node_idx = -1;
+/**********************/
+/* SHORTEST PATH TREE */
+/**********************/
 
-    // Check all edges to find the next node in the path
-    for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-      if (!validate_edge(graph, i))
-        continue;
+// Shortest path tree from source to every node, kept up to date as nodes
+// move. distance is INFINITY for nodes that cannot be reached. The tree
+// is current when its version tags match the graph. Topology changes
+// require a rebuild, node moves can be repaired.
+typedef struct {
+  u64 topology_version;
+  u64 geometry_version;
+  i64 source;
+  i64 capacity;
+  f64 *distance;
+  i64 *prev_edge;
+  Heap heap;
+
+  // Repair scratch, the subtrees cut off by changed edges
+  u64 *affected;
+  i64 num_affected;
+  i64 *affected_nodes;
+
+  i64 nodes_repaired;
+} Path_Tree;
+
+Path_Tree path_tree = {0};
+
+// Settle the nodes in the heap in order, lowering the distances of their
+// neighbors. Every label must already be an upper bound that is only
+// wrong where a node in the heap could lower it.
+void path_tree_settle(Graph *graph, Path_Tree *tree) {
+  Adjacency *adj = &graph->adjacency;
 
-      Edge edge = graph->edges[i];
-      Node node0 = graph->nodes[edge.src];
-      Node node1 = graph->nodes[edge.dst];
+  while (tree->heap.size > 0) {
+    f64 dist;
+    i64 node_idx = heap_pop(&tree->heap, &dist);
 
-      f64 length = get_distance(node0.x, node0.y, node1.x, node1.y);
+    tree->nodes_repaired++;
 
-      // Check for the nearest node along the current path
-      if (edge.src == curr_node_idx && node1.distance >= 0 &&
-          (dist < 0 || node1.distance + length < dist)) {
-        next_node_idx = edge.dst;
+    for (i64 k = adj->offsets[node_idx]; k < adj->offsets[node_idx + 1]; ++k) {
+      i64 edge_idx = adj->edge_ids[k];
+      i64 next_idx = adj->neighbors[k];
+      f64 next_dist = dist + graph->edge_cost[edge_idx];
 
-        assert(graph->path_size < MAX_PATH_SIZE);
+      if (next_dist < tree->distance[next_idx]) {
+        tree->distance[next_idx] = next_dist;
+        tree->prev_edge[next_idx] = edge_idx;
+        heap_push(&tree->heap, next_idx, next_dist);
+      }
+    }
+  }
+}
+
+void build_path_tree(Graph *graph, Path_Tree *tree, i64 src) {
+  get_adjacency(graph);
+  get_edge_costs(graph);
+  heap_reserve(&tree->heap, graph->num_nodes);
+
+  if (tree->capacity < graph->num_nodes) {
+    i64 n = graph->num_nodes;
+
+    tree->distance = resize_array(tree->distance, tree->capacity, n, sizeof(f64));
+    tree->prev_edge =
+        resize_array(tree->prev_edge, tree->capacity, n, sizeof(i64));
+    tree->affected = resize_array(tree->affected, bitset_words(tree->capacity),
+                                  bitset_words(n), sizeof(u64));
+    tree->affected_nodes =
+        resize_array(tree->affected_nodes, tree->capacity, n, sizeof(i64));
+    tree->capacity = n;
+  }
+
+  for (i64 i = 0; i < graph->num_nodes; ++i) {
+    tree->distance[i] = INFINITY;
+    tree->prev_edge[i] = -1;
+  }
+
+  tree->source = src;
+  tree->nodes_repaired = 0;
+  tree->distance[src] = 0;
+  heap_clear(&tree->heap);
+  heap_push(&tree->heap, src, 0);
+  path_tree_settle(graph, tree);
+
+  tree->topology_version = graph->topology_version;
+  tree->geometry_version = graph->geometry_version;
+}
+
+b8 path_tree_is_current(Graph *graph, Path_Tree *tree, i64 src) {
+  return tree->source == src &&
+         tree->topology_version == graph->topology_version &&
+         tree->geometry_version == graph->geometry_version;
+}
+
+void path_tree_cut(Graph *graph, Path_Tree *tree, i64 root) {
+  Adjacency *adj = &graph->adjacency;
 
-        graph->path[graph->path_size] = i;
-        graph->path_size++;
+  if (bit_get(tree->affected, root))
+    return;
+
+  i64 first = tree->num_affected;
+  bit_set(tree->affected, root, 1);
+  tree->affected_nodes[tree->num_affected++] = root;
+
+  // Children are the neighbors whose tree edge leads here
+  for (i64 i = first; i < tree->num_affected; ++i) {
+    i64 node_idx = tree->affected_nodes[i];
+
+    for (i64 k = adj->offsets[node_idx]; k < adj->offsets[node_idx + 1]; ++k) {
+      i64 next_idx = adj->neighbors[k];
 
-        dist = node1.distance + length;
+      if (tree->prev_edge[next_idx] == adj->edge_ids[k] &&
+          !bit_get(tree->affected, next_idx)) {
+        bit_set(tree->affected, next_idx, 1);
+        tree->affected_nodes[tree->num_affected++] = next_idx;
       }
-      if (edge.dst == curr_node_idx && node0.distance >= 0 &&
-          (dist < 0 || node0.distance + length < dist)) {
-        next_node_idx = edge.src;
+    }
+  }
+}
+
+// Update the tree after the nodes have moved, which changes the lengths
+// of their edges only. Subtrees hanging off changed tree edges are cut
+// off and reattached through their best neighbor outside the cut, and
+// changed edges that now give a shortcut are relaxed. Only the cut
+// nodes, the nodes whose distance drops and their neighbors are visited.
+//
+// The tree must have been current at geometry_version, with the moves
+// the only change since, otherwise it is left stale for the next query
+// to rebuild.
+void repair_path_tree(Graph *graph, Path_Tree *tree, i64 *nodes, i64 count,
+                      u64 geometry_version) {
+  if (tree->topology_version != graph->topology_version ||
+      tree->geometry_version != geometry_version)
+    return;
+
+  tree->geometry_version = graph->geometry_version;
+  tree->nodes_repaired = 0;
+
+  if (count == 0)
+    return;
+
+  Adjacency *adj = get_adjacency(graph);
+  get_edge_costs(graph);
+
+  tree->num_affected = 0;
+
+  for (i64 i = 0; i < count; ++i) {
+    i64 node_idx = nodes[i];
+
+    for (i64 k = adj->offsets[node_idx]; k < adj->offsets[node_idx + 1]; ++k) {
+      i64 edge_idx = adj->edge_ids[k];
+      i64 next_idx = adj->neighbors[k];
 
-        assert(graph->path_size < MAX_PATH_SIZE);
+      if (tree->prev_edge[next_idx] == edge_idx)
+        path_tree_cut(graph, tree, next_idx);
+      else if (tree->prev_edge[node_idx] == edge_idx)
+        path_tree_cut(graph, tree, node_idx);
+    }
+  }
+
+  for (i64 i = 0; i < tree->num_affected; ++i) {
+    i64 cut_idx = tree->affected_nodes[i];
+
+    tree->distance[cut_idx] = INFINITY;
+    tree->prev_edge[cut_idx] = -1;
+  }
+
+  // Reattach cut nodes through neighbors that kept their distance
+  for (i64 i = 0; i < tree->num_affected; ++i) {
+    i64 cut_idx = tree->affected_nodes[i];
+
+    for (i64 k = adj->offsets[cut_idx]; k < adj->offsets[cut_idx + 1]; ++k) {
+      i64 edge_idx = adj->edge_ids[k];
+      i64 next_idx = adj->neighbors[k];
+
+      if (bit_get(tree->affected, next_idx))
+        continue;
 
-        graph->path[graph->path_size] = i;
-        graph->path_size++;
+      f64 dist = tree->distance[next_idx] + graph->edge_cost[edge_idx];
 
-        dist = node0.distance + length;
+      if (dist < tree->distance[cut_idx]) {
+        tree->distance[cut_idx] = dist;
+        tree->prev_edge[cut_idx] = edge_idx;
       }
     }
 
-    // If no next node is found, there's an error
-    if (next_node_idx < 0) {
-      printf("Internal error\n");
-      break;
+    if (tree->distance[cut_idx] < INFINITY)
+      heap_push(&tree->heap, cut_idx, tree->distance[cut_idx]);
+  }
+
+  // Changed edges between nodes that were not cut may now be shortcuts
+  for (i64 i = 0; i < count; ++i) {
+    i64 node_idx = nodes[i];
+
+    for (i64 k = adj->offsets[node_idx]; k < adj->offsets[node_idx + 1]; ++k) {
+      i64 edge_idx = adj->edge_ids[k];
+      i64 next_idx = adj->neighbors[k];
+      f64 length = graph->edge_cost[edge_idx];
+
+      if (bit_get(tree->affected, node_idx) ||
+          bit_get(tree->affected, next_idx))
+        continue;
+
+      if (tree->distance[node_idx] + length < tree->distance[next_idx]) {
+        tree->distance[next_idx] = tree->distance[node_idx] + length;
+        tree->prev_edge[next_idx] = edge_idx;
+        heap_push(&tree->heap, next_idx, tree->distance[next_idx]);
+      } else if (tree->distance[next_idx] + length < tree->distance[node_idx]) {
+        tree->distance[node_idx] = tree->distance[next_idx] + length;
+        tree->prev_edge[node_idx] = edge_idx;
+        heap_push(&tree->heap, node_idx, tree->distance[node_idx]);
+      }
     }
+  }
 
-    // Highlight the current node and edge as part of the path
-    graph->nodes[next_node_idx].highlight = 1;
-    /* graph->edges[edge_to_highlight].highlight = 1; */
+  for (i64 i = 0; i < tree->num_affected; ++i)
+    bit_set(tree->affected, tree->affected_nodes[i], 0);
 
-    if (curr_node_idx == next_node_idx) {
-      printf("Internal error\n");
-      break;
+  path_tree_settle(graph, tree);
+}
+
+/******************/
+/* DELTA-STEPPING */
+/******************/
+
+// State of the parallel single-source search. distance is INFINITY for
+// nodes that cannot be reached.
+typedef struct {
+  i64 capacity;
+  f64 *distance;
+  i64 *prev_edge;
+
+  f64 delta;
+  Graph_View view;
+
+  // Node lists by distance / delta. A node is listed again whenever its
+  // distance drops, older entries are skipped when their bucket comes up.
+  // The buckets are kept across runs, a run only scans up to the highest
+  // one it pushed to.
+  i64 buckets_capacity;
+  Index_List *buckets;
+  i64 last_bucket;
+
+  // Nodes relaxed in the current round and those settled in the current
+  // bucket, deduplicated with the marks
+  Index_List frontier;
+  Index_List settled;
+  i64 *frontier_mark;
+  i64 *settled_mark;
+
+  // Per worker list of the nodes it improved in the last round
+  Index_List updated[MAX_WORKERS];
+  i64 worker_edges_relaxed[MAX_WORKERS];
+  b8 heavy;
+
+  i64 num_rounds;
+  i64 nodes_settled;
+  i64 edges_relaxed;
+} Delta_Stepping;
+
+Delta_Stepping delta_stepping = {0};
+
+// Bucket width used by highlight_path, 0 picks the mean edge length.
+// Small values approach Dijkstra with many short rounds, large ones
+// Bellman-Ford with few rounds that do redundant work.
+f64 delta_stepping_delta = 0;
+
+i64 delta_bucket(Delta_Stepping *state, f64 dist) {
+  return (i64)(dist / state->delta);
+}
+
+void delta_bucket_push(Delta_Stepping *state, i64 bucket, i64 node_idx) {
+  if (bucket >= state->buckets_capacity) {
+    i64 capacity = state->buckets_capacity > 0 ? state->buckets_capacity : 64;
+    while (capacity <= bucket)
+      capacity *= 2;
+
+    state->buckets = resize_array(state->buckets, state->buckets_capacity,
+                                  capacity, sizeof(Index_List));
+    state->buckets_capacity = capacity;
+  }
+
+  index_list_push(&state->buckets[bucket], node_idx);
+
+  if (state->last_bucket < bucket)
+    state->last_bucket = bucket;
+}
+
+// Relax the light (at most delta long) or heavy edges of frontier nodes.
+// Distances are lowered atomically, every worker keeps its own list of
+// the nodes it improved.
+void delta_relax_task(void *data, i64 worker, i64 begin, i64 end) {
+  Delta_Stepping *state = data;
+  Graph_View *view = &state->view;
+  Index_List *updated = &state->updated[worker];
+  i64 edges_relaxed = 0;
+
+  for (i64 i = begin; i < end; ++i) {
+    i64 node_idx = state->frontier.items[i];
+    f64 dist = atomic_load_f64(&state->distance[node_idx]);
+
+    for (i64 k = view->offsets[node_idx]; k < view->offsets[node_idx + 1];
+         ++k) {
+      i64 next_idx = view->neighbors[k];
+      f64 length = view->edge_cost[view->edge_ids[k]];
+
+      if ((length > state->delta) != state->heavy)
+        continue;
+
+      edges_relaxed++;
+
+      if (atomic_min_f64(&state->distance[next_idx], dist + length))
+        index_list_push(updated, next_idx);
+    }
+  }
+
+  state->worker_edges_relaxed[worker] += edges_relaxed;
+}
+
+// Pick for every reached node an edge from a strictly closer neighbor that
+// accounts for its distance exactly. Relaxations race, so the edges are
+// not tracked while searching. Nodes reached only over zero-length edges
+// are left at -1.
+void delta_prev_edge_task(void *data, i64 worker, i64 begin, i64 end) {
+  Delta_Stepping *state = data;
+  Graph_View *view = &state->view;
+
+  for (i64 node_idx = begin; node_idx < end; ++node_idx) {
+    f64 dist = state->distance[node_idx];
+
+    state->prev_edge[node_idx] = -1;
+
+    if (dist == 0 || dist == INFINITY)
+      continue;
+
+    for (i64 k = view->offsets[node_idx]; k < view->offsets[node_idx + 1];
+         ++k) {
+      i64 next_idx = view->neighbors[k];
+      f64 next_dist = state->distance[next_idx];
+
+      if (next_dist < dist &&
+          next_dist + view->edge_cost[view->edge_ids[k]] == dist) {
+        state->prev_edge[node_idx] = view->edge_ids[k];
+        break;
+      }
+    }
+  }
+}
+
+// Run one relaxation round over the frontier, then file the improved
+// nodes into their buckets.
+void delta_round(Delta_Stepping *state, Worker_Pool *pool, i64 bucket,
+                 b8 heavy) {
+  state->heavy = heavy;
+  state->num_rounds++;
+  pool_run(pool, state->frontier.size, 64, delta_relax_task, state);
+
+  for (i64 w = 0; w < MAX_WORKERS; ++w) {
+    Index_List *updated = &state->updated[w];
+
+    for (i64 i = 0; i < updated->size; ++i) {
+      i64 node_idx = updated->items[i];
+      i64 next_bucket = delta_bucket(state, state->distance[node_idx]);
+
+      // Rounding may place a distance just below the current bucket
+      delta_bucket_push(state, next_bucket > bucket ? next_bucket : bucket,
+                        node_idx);
     }
 
-    // Move to the next node in the path
-    curr_node_idx = next_node_idx;
-    printf("%lld\n", curr_node_idx);
+    updated->size = 0;
+  }
+}
+
+// Delta-stepping single-source shortest paths (Meyer and Sanders). Nodes
+// are kept in buckets of width delta and buckets are taken in order. The
+// light edges of a bucket are relaxed in rounds until it stays empty,
+// since they may put nodes back into it, then the heavy edges of every
+// node settled in it are relaxed once. All relaxations of a round run in
+// parallel over the pool. Distances are exact, prev_edge is filled in
+// afterwards. A delta of 0 or less picks the mean edge length.
+void find_shortest_paths_delta(Graph *graph, Delta_Stepping *state,
+                               Worker_Pool *pool, i64 src, f64 delta) {
+  state->view = get_graph_view(graph);
+  Graph_View *view = &state->view;
+  i64 n = view->num_nodes;
+
+  if (state->capacity < n) {
+    state->distance =
+        resize_array(state->distance, state->capacity, n, sizeof(f64));
+    state->prev_edge =
+        resize_array(state->prev_edge, state->capacity, n, sizeof(i64));
+    state->frontier_mark =
+        resize_array(state->frontier_mark, state->capacity, n, sizeof(i64));
+    state->settled_mark =
+        resize_array(state->settled_mark, state->capacity, n, sizeof(i64));
+    state->capacity = n;
+  }
+
+  if (delta <= 0) {
+    f64 total = 0;
+    i64 count = view->offsets[n];
+
+    for (i64 k = 0; k < count; ++k)
+      total += view->edge_cost[view->edge_ids[k]];
+
+    delta = count > 0 ? total / count : 1;
+  }
+
+  state->delta = delta;
+  state->num_rounds = 0;
+  state->nodes_settled = 0;
+
+  for (i64 w = 0; w < MAX_WORKERS; ++w)
+    state->worker_edges_relaxed[w] = 0;
+
+  for (i64 i = 0; i < n; ++i) {
+    state->distance[i] = INFINITY;
+    state->frontier_mark[i] = -1;
+    state->settled_mark[i] = -1;
   }
 
-  for (i64 i = 1; i < graph->path_size; ++i) {
-    graph->edges[graph->path[i]].highlight = 1;
+  state->distance[src] = 0;
+  state->last_bucket = -1;
+  delta_bucket_push(state, 0, src);
+
+  i64 round = 0;
+
+  for (i64 bucket = 0; bucket <= state->last_bucket; ++bucket) {
+    state->settled.size = 0;
+
+    // Rounds push to the buckets and may move them, so the list is looked
+    // up again after each one
+    while (state->buckets[bucket].size > 0) {
+      Index_List *list = &state->buckets[bucket];
+
+      // Take the nodes still in this bucket, each once
+      state->frontier.size = 0;
+      round++;
+
+      for (i64 i = 0; i < list->size; ++i) {
+        i64 node_idx = list->items[i];
+
+        if (delta_bucket(state, state->distance[node_idx]) > bucket ||
+            state->frontier_mark[node_idx] == round)
+          continue;
+
+        state->frontier_mark[node_idx] = round;
+        index_list_push(&state->frontier, node_idx);
+
+        if (state->settled_mark[node_idx] != bucket) {
+          state->settled_mark[node_idx] = bucket;
+          index_list_push(&state->settled, node_idx);
+        }
+      }
+
+      list->size = 0;
+
+      if (state->frontier.size > 0)
+        delta_round(state, pool, bucket, 0);
+    }
+
+    state->nodes_settled += state->settled.size;
+
+    if (state->settled.size > 0) {
+      Index_List frontier = state->frontier;
+      state->frontier = state->settled;
+      delta_round(state, pool, bucket, 1);
+      state->settled = state->frontier;
+      state->frontier = frontier;
+    }
   }
+
+  pool_run(pool, n, 1024, delta_prev_edge_task, state);
+
+  state->edges_relaxed = 0;
+  for (i64 w = 0; w < MAX_WORKERS; ++w)
+    state->edges_relaxed += state->worker_edges_relaxed[w];
+}
+
+/*************************/
+/* CONTRACTION HIERARCHY */
+/*************************/
+
+enum {
+  CH_WITNESS_SETTLE_LIMIT = 256,
+};
+
+// Nodes are contracted one by one in rank order. Contracting a node adds
+// a shortcut arc between each pair of its remaining neighbors whose
+// shortest connection goes through it. A query then only ever has to
+// go up in rank, from both ends.
+//
+// Arcs are original edges (edge >= 0) or shortcuts, which stand for
+// child[0] from a to middle followed by child[1] from middle to b. Arcs
+// are listed in the up index of their lower ranked end.
+typedef struct {
+  u64 topology_version;
+  u64 geometry_version;
+  u64 fingerprint;
+
+  i64 num_nodes;
+  i64 *rank;
+
+  i64 arcs_capacity;
+  i64 num_arcs;
+  i64 num_shortcuts;
+  i64 *arc_a;
+  i64 *arc_b;
+  f64 *arc_weight;
+  i64 *arc_edge;
+  i64 *arc_middle;
+  i64 *arc_child[2];
+
+  i64 *up_offsets;
+  i64 *up_arcs;
+} Contraction_Hierarchy;
+
+// Search scratch. Only the touched entries are reset between queries, so
+// a query costs no more than the part of the graph it visits.
+typedef struct {
+  i64 capacity;
+  f64 *distance;
+  i64 *prev_arc;
+  Heap heap;
+  Index_List touched;
+  Index_List unpack;
+
+  i64 nodes_settled;
+} Ch_Search;
+
+Contraction_Hierarchy contraction_hierarchy = {0};
+Ch_Search ch_search = {0};
+Ch_Search ch_search_reverse = {0};
+
+void ch_search_reserve(Ch_Search *search, i64 num_nodes) {
+  heap_reserve(&search->heap, num_nodes);
+
+  if (num_nodes <= search->capacity)
+    return;
+
+  search->distance = resize_array(search->distance, search->capacity,
+                                  num_nodes, sizeof(f64));
+  search->prev_arc = resize_array(search->prev_arc, search->capacity,
+                                  num_nodes, sizeof(i64));
+
+  for (i64 i = search->capacity; i < num_nodes; ++i) {
+    search->distance[i] = INFINITY;
+    search->prev_arc[i] = -1;
+  }
+
+  search->capacity = num_nodes;
+}
+
+void ch_search_reset(Ch_Search *search) {
+  for (i64 i = 0; i < search->touched.size; ++i) {
+    search->distance[search->touched.items[i]] = INFINITY;
+    search->prev_arc[search->touched.items[i]] = -1;
+  }
+
+  search->touched.size = 0;
+  search->nodes_settled = 0;
+  heap_clear(&search->heap);
+}
+
+void ch_search_reach(Ch_Search *search, i64 node_idx, f64 dist, i64 arc) {
+  if (search->distance[node_idx] == INFINITY)
+    index_list_push(&search->touched, node_idx);
+
+  search->distance[node_idx] = dist;
+  search->prev_arc[node_idx] = arc;
+  heap_push(&search->heap, node_idx, dist);
+}
+
+void ch_reserve_arcs(Contraction_Hierarchy *ch, i64 num_arcs) {
+  if (num_arcs > ch->arcs_capacity) {
+    i64 old = ch->arcs_capacity;
+    i64 capacity = old > 0 ? old : 256;
+    while (capacity < num_arcs)
+      capacity *= 2;
+
+    ch->arc_a = resize_array(ch->arc_a, old, capacity, sizeof(i64));
+    ch->arc_b = resize_array(ch->arc_b, old, capacity, sizeof(i64));
+    ch->arc_weight = resize_array(ch->arc_weight, old, capacity, sizeof(f64));
+    ch->arc_edge = resize_array(ch->arc_edge, old, capacity, sizeof(i64));
+    ch->arc_middle = resize_array(ch->arc_middle, old, capacity, sizeof(i64));
+    ch->arc_child[0] =
+        resize_array(ch->arc_child[0], old, capacity, sizeof(i64));
+    ch->arc_child[1] =
+        resize_array(ch->arc_child[1], old, capacity, sizeof(i64));
+    ch->arcs_capacity = capacity;
+  }
+}
+
+i64 ch_add_arc(Contraction_Hierarchy *ch, i64 a, i64 b, f64 weight,
+               i64 edge_idx) {
+  ch_reserve_arcs(ch, ch->num_arcs + 1);
+
+  i64 arc = ch->num_arcs++;
+
+  ch->arc_a[arc] = a;
+  ch->arc_b[arc] = b;
+  ch->arc_weight[arc] = weight;
+  ch->arc_edge[arc] = edge_idx;
+  ch->arc_middle[arc] = -1;
+  ch->arc_child[0][arc] = -1;
+  ch->arc_child[1][arc] = -1;
+
+  return arc;
+}
+
+i64 ch_arc_other(Contraction_Hierarchy *ch, i64 arc, i64 node_idx) {
+  return ch->arc_a[arc] == node_idx ? ch->arc_b[arc] : ch->arc_a[arc];
+}
+
+// Working state of the contraction, arcs by node and the lightest arc to
+// every remaining neighbor of the node being contracted.
+typedef struct {
+  Index_List *arcs;
+  i64 *best_arc;
+  i64 *deleted_neighbors;
+  Index_List neighbors;
+
+  // Nodes the current witness search looks for, marked with its round
+  i64 *target_round;
+  i64 round;
+  Ch_Search witness;
+  Heap order;
+} Ch_Builder;
+
+// Remaining neighbors of the node, through their lightest arc.
+void ch_collect_neighbors(Contraction_Hierarchy *ch, Ch_Builder *builder,
+                          i64 node_idx) {
+  Index_List *arcs = &builder->arcs[node_idx];
+  builder->neighbors.size = 0;
+
+  for (i64 i = 0; i < arcs->size; ++i) {
+    i64 arc = arcs->items[i];
+    i64 next_idx = ch_arc_other(ch, arc, node_idx);
+
+    if (ch->rank[next_idx] >= 0)
+      continue;
+
+    i64 best = builder->best_arc[next_idx];
+
+    if (best < 0)
+      index_list_push(&builder->neighbors, next_idx);
+    if (best < 0 || ch->arc_weight[arc] < ch->arc_weight[best])
+      builder->best_arc[next_idx] = arc;
+  }
+}
+
+// Dijkstra from src over the remaining nodes except the one being
+// contracted, until the targets are settled, the distance limit is passed
+// or a fixed number of nodes is settled. Distances found are upper
+// bounds, which is all a witness needs.
+void ch_witness_search(Contraction_Hierarchy *ch, Ch_Builder *builder,
+                       i64 src, i64 skip, f64 limit, i64 num_targets) {
+  Ch_Search *search = &builder->witness;
+  ch_search_reset(search);
+  ch_search_reach(search, src, 0, -1);
+
+  while (search->heap.size > 0 && num_targets > 0 &&
+         search->nodes_settled < CH_WITNESS_SETTLE_LIMIT) {
+    f64 dist;
+    i64 node_idx = heap_pop(&search->heap, &dist);
+
+    if (dist > limit)
+      break;
+
+    if (builder->target_round[node_idx] == builder->round)
+      num_targets--;
+
+    search->nodes_settled++;
+    Index_List *arcs = &builder->arcs[node_idx];
+
+    for (i64 i = 0; i < arcs->size; ++i) {
+      i64 arc = arcs->items[i];
+      i64 next_idx = ch_arc_other(ch, arc, node_idx);
+      f64 next_dist = dist + ch->arc_weight[arc];
+
+      if (next_idx == skip || ch->rank[next_idx] >= 0)
+        continue;
+
+      if (next_dist < search->distance[next_idx])
+        ch_search_reach(search, next_idx, next_dist, arc);
+    }
+  }
+}
+
+// Contract the node, or only count the shortcuts it would need. Returns
+// the number of shortcuts.
+i64 ch_contract(Contraction_Hierarchy *ch, Ch_Builder *builder, i64 node_idx,
+                b8 simulate) {
+  ch_collect_neighbors(ch, builder, node_idx);
+
+  i64 *neighbors = builder->neighbors.items;
+  i64 num_neighbors = builder->neighbors.size;
+  i64 num_shortcuts = 0;
+
+  for (i64 i = 0; i + 1 < num_neighbors; ++i) {
+    i64 u = neighbors[i];
+    i64 arc_u = builder->best_arc[u];
+    f64 weight_u = ch->arc_weight[arc_u];
+
+    // Pairs with earlier neighbors were covered by their searches
+    f64 max_weight = 0;
+    builder->round++;
+
+    for (i64 j = i + 1; j < num_neighbors; ++j) {
+      builder->target_round[neighbors[j]] = builder->round;
+      if (max_weight < ch->arc_weight[builder->best_arc[neighbors[j]]])
+        max_weight = ch->arc_weight[builder->best_arc[neighbors[j]]];
+    }
+
+    ch_witness_search(ch, builder, u, node_idx, weight_u + max_weight,
+                      num_neighbors - 1 - i);
+
+    for (i64 j = i + 1; j < num_neighbors; ++j) {
+      i64 w = neighbors[j];
+      i64 arc_w = builder->best_arc[w];
+      f64 weight = weight_u + ch->arc_weight[arc_w];
+
+      if (builder->witness.distance[w] <= weight)
+        continue;
+
+      num_shortcuts++;
+
+      if (simulate)
+        continue;
+
+      i64 arc = ch_add_arc(ch, u, w, weight, -1);
+      ch->arc_middle[arc] = node_idx;
+      ch->arc_child[0][arc] = arc_u;
+      ch->arc_child[1][arc] = arc_w;
+      index_list_push(&builder->arcs[u], arc);
+      index_list_push(&builder->arcs[w], arc);
+      ch->num_shortcuts++;
+    }
+  }
+
+  for (i64 i = 0; i < num_neighbors; ++i) {
+    i64 next_idx = neighbors[i];
+    builder->best_arc[next_idx] = -1;
+
+    if (simulate)
+      continue;
+
+    // Arcs to the contracted node now only matter to it
+    Index_List *arcs = &builder->arcs[next_idx];
+
+    for (i64 k = 0; k < arcs->size;)
+      if (ch_arc_other(ch, arcs->items[k], next_idx) == node_idx)
+        arcs->items[k] = arcs->items[--arcs->size];
+      else
+        ++k;
+  }
+
+  return num_shortcuts;
+}
+
+// Nodes are ordered by edge difference, the shortcuts a contraction adds
+// minus the arcs it removes, plus the number of contracted neighbors to
+// spread contractions evenly over the graph.
+f64 ch_priority(Contraction_Hierarchy *ch, Ch_Builder *builder,
+                i64 node_idx) {
+  i64 num_shortcuts = ch_contract(ch, builder, node_idx, 1);
+
+  return (f64)(num_shortcuts - builder->neighbors.size) +
+         builder->deleted_neighbors[node_idx];
+}
+
+void ch_build_up_index(Contraction_Hierarchy *ch) {
+  i64 n = ch->num_nodes;
+
+  ch->up_offsets = resize_array(ch->up_offsets, 0, n + 1, sizeof(i64));
+  ch->up_arcs = resize_array(ch->up_arcs, 0, ch->num_arcs, sizeof(i64));
+
+  for (i64 arc = 0; arc < ch->num_arcs; ++arc) {
+    i64 a = ch->arc_a[arc];
+    i64 b = ch->arc_b[arc];
+    ch->up_offsets[(ch->rank[a] < ch->rank[b] ? a : b) + 1]++;
+  }
+
+  for (i64 i = 0; i < n; ++i)
+    ch->up_offsets[i + 1] += ch->up_offsets[i];
+
+  for (i64 arc = 0; arc < ch->num_arcs; ++arc) {
+    i64 a = ch->arc_a[arc];
+    i64 b = ch->arc_b[arc];
+    ch->up_arcs[ch->up_offsets[ch->rank[a] < ch->rank[b] ? a : b]++] = arc;
+  }
+
+  for (i64 i = n; i > 0; --i)
+    ch->up_offsets[i] = ch->up_offsets[i - 1];
+  ch->up_offsets[0] = 0;
+}
+
+void build_contraction_hierarchy(Graph *graph, Contraction_Hierarchy *ch) {
+  i64 n = graph->num_nodes;
+  Ch_Builder builder = {0};
+  get_edge_costs(graph);
+
+  builder.arcs = resize_array(NULL, 0, n, sizeof(Index_List));
+  builder.best_arc = resize_array(NULL, 0, n, sizeof(i64));
+  builder.deleted_neighbors = resize_array(NULL, 0, n, sizeof(i64));
+  builder.target_round = resize_array(NULL, 0, n, sizeof(i64));
+  ch_search_reserve(&builder.witness, n);
+  heap_reserve(&builder.order, n);
+
+  ch->num_nodes = n;
+  ch->num_arcs = 0;
+  ch->num_shortcuts = 0;
+  ch->rank = resize_array(ch->rank, 0, n, sizeof(i64));
+
+  for (i64 i = 0; i < n; ++i) {
+    ch->rank[i] = -1;
+    builder.best_arc[i] = -1;
+  }
+
+  for (i64 i = 0; i < graph->num_edges; ++i) {
+    if (!adjacency_includes(graph, i))
+      continue;
+
+    i64 arc = ch_add_arc(ch, graph->edge_src[i], graph->edge_dst[i],
+                         graph->edge_cost[i], i);
+    index_list_push(&builder.arcs[graph->edge_src[i]], arc);
+    index_list_push(&builder.arcs[graph->edge_dst[i]], arc);
+  }
+
+  for (i64 i = 0; i < n; ++i)
+    if (bit_get(graph->node_enabled, i))
+      heap_push(&builder.order, i, ch_priority(ch, &builder, i));
+
+  // Lazy updates, a node is only contracted if its priority is still the
+  // lowest once recomputed
+  i64 next_rank = 0;
+
+  while (builder.order.size > 0) {
+    f64 key;
+    i64 node_idx = heap_pop(&builder.order, &key);
+    f64 priority = ch_priority(ch, &builder, node_idx);
+
+    if (builder.order.size > 0 && priority > builder.order.keys[0]) {
+      heap_push(&builder.order, node_idx, priority);
+      continue;
+    }
+
+    ch_contract(ch, &builder, node_idx, 0);
+    ch->rank[node_idx] = next_rank++;
+
+    for (i64 i = 0; i < builder.neighbors.size; ++i) {
+      i64 next_idx = builder.neighbors.items[i];
+      builder.deleted_neighbors[next_idx]++;
+      heap_update(&builder.order, next_idx,
+                  builder.order.keys[builder.order.slots[next_idx] - 1] + 1);
+    }
+  }
+
+  ch_build_up_index(ch);
+
+  for (i64 i = 0; i < n; ++i)
+    free(builder.arcs[i].items);
+  free(builder.arcs);
+  free(builder.best_arc);
+  free(builder.deleted_neighbors);
+  free(builder.target_round);
+  free(builder.neighbors.items);
+  free(builder.witness.distance);
+  free(builder.witness.prev_arc);
+  free(builder.witness.touched.items);
+  free(builder.witness.heap.nodes);
+  free(builder.witness.heap.keys);
+  free(builder.witness.heap.slots);
+  free(builder.order.nodes);
+  free(builder.order.keys);
+  free(builder.order.slots);
+
+  ch->topology_version = graph->topology_version;
+  ch->geometry_version = graph->geometry_version;
+  ch->fingerprint = graph_fingerprint(graph);
+}
+
+b8 contraction_hierarchy_is_current(Graph *graph, Contraction_Hierarchy *ch) {
+  return ch->topology_version == graph->topology_version &&
+         ch->geometry_version == graph->geometry_version;
+}
+
+// Settle the nearest node of one side, following only arcs up in rank.
+void ch_query_step(Contraction_Hierarchy *ch, Ch_Search *side,
+                   Ch_Search *other, f64 *best, i64 *meet) {
+  f64 dist;
+  i64 node_idx = heap_pop(&side->heap, &dist);
+
+  side->nodes_settled++;
+
+  if (dist + other->distance[node_idx] < *best) {
+    *best = dist + other->distance[node_idx];
+    *meet = node_idx;
+  }
+
+  i64 k0 = ch->up_offsets[node_idx];
+  i64 k1 = ch->up_offsets[node_idx + 1];
+
+  // Stall on demand, a node reached shorter from above through one of its
+  // arcs is not on a shortest up path, so its arcs need no relaxing
+  for (i64 k = k0; k < k1; ++k) {
+    i64 arc = ch->up_arcs[k];
+    i64 next_idx = ch_arc_other(ch, arc, node_idx);
+
+    if (side->distance[next_idx] + ch->arc_weight[arc] < dist)
+      return;
+  }
+
+  for (i64 k = k0; k < k1; ++k) {
+    i64 arc = ch->up_arcs[k];
+    i64 next_idx = ch_arc_other(ch, arc, node_idx);
+    f64 next_dist = dist + ch->arc_weight[arc];
+
+    if (next_dist < side->distance[next_idx])
+      ch_search_reach(side, next_idx, next_dist, arc);
+  }
+}
+
+// Bidirectional search up the hierarchy from src and dst. The shortest
+// path is the best sum at a node both sides reach. Its arcs are unpacked
+// into original edges and written to result like the other engines do:
+// distance[dst] is the length, -1 if unreachable, and prev_edge is set
+// along the path only.
+void find_shortest_path_ch(Graph *graph, Contraction_Hierarchy *ch,
+                           Ch_Search *forward, Ch_Search *backward,
+                           Path_Search *result, i64 src, i64 dst) {
+  ch_search_reserve(forward, ch->num_nodes);
+  ch_search_reserve(backward, ch->num_nodes);
+  path_search_reserve(result, graph->num_nodes);
+  ch_search_reset(forward);
+  ch_search_reset(backward);
+
+  ch_search_reach(forward, src, 0, -1);
+  ch_search_reach(backward, dst, 0, -1);
+
+  f64 best = INFINITY;
+  i64 meet = -1;
+
+  for (;;) {
+    // A side is done once its frontier is past the best path
+    if (forward->heap.size > 0 && forward->heap.keys[0] >= best)
+      heap_clear(&forward->heap);
+    if (backward->heap.size > 0 && backward->heap.keys[0] >= best)
+      heap_clear(&backward->heap);
+
+    if (forward->heap.size == 0 && backward->heap.size == 0)
+      break;
+
+    if (backward->heap.size == 0 ||
+        (forward->heap.size > 0 &&
+         forward->heap.keys[0] <= backward->heap.keys[0]))
+      ch_query_step(ch, forward, backward, &best, &meet);
+    else
+      ch_query_step(ch, backward, forward, &best, &meet);
+  }
+
+  result->nodes_expanded = forward->nodes_settled + backward->nodes_settled;
+  result->edges_relaxed = 0;
+  result->prev_edge[src] = -1;
+
+  if (meet < 0) {
+    result->distance[dst] = -1;
+    return;
+  }
+
+  result->distance[dst] = best;
+
+  // Stack of arcs to unpack, each with the node it leads to along the path
+  Index_List *stack = &forward->unpack;
+  stack->size = 0;
+
+  for (i64 curr = meet; curr != src;) {
+    i64 arc = forward->prev_arc[curr];
+    index_list_push(stack, arc);
+    index_list_push(stack, curr);
+    curr = ch_arc_other(ch, arc, curr);
+  }
+
+  for (i64 curr = meet; curr != dst;) {
+    i64 arc = backward->prev_arc[curr];
+    i64 next = ch_arc_other(ch, arc, curr);
+    index_list_push(stack, arc);
+    index_list_push(stack, next);
+    curr = next;
+  }
+
+  while (stack->size > 0) {
+    i64 to = stack->items[--stack->size];
+    i64 arc = stack->items[--stack->size];
+
+    if (ch->arc_edge[arc] >= 0) {
+      result->prev_edge[to] = ch->arc_edge[arc];
+      continue;
+    }
+
+    i64 middle = ch->arc_middle[arc];
+    i64 near = ch->arc_a[arc] == to ? 0 : 1;
+
+    index_list_push(stack, ch->arc_child[near][arc]);
+    index_list_push(stack, to);
+    index_list_push(stack, ch->arc_child[1 - near][arc]);
+    index_list_push(stack, middle);
+  }
+}
+
+// The hierarchy file holds the arcs and ranks, tagged with the
+// fingerprint of the graph they were built from. Up index and versions
+// are restored on load.
+enum {
+  CH_FILE_MAGIC = 0x31484347, // "GCH1"
+};
+
+b8 ch_write(FILE *f, void *data, i64 count, i64 elem_size) {
+  return (i64)fwrite(data, elem_size, count, f) == count;
+}
+
+b8 ch_read(FILE *f, void *data, i64 count, i64 elem_size) {
+  return (i64)fread(data, elem_size, count, f) == count;
+}
+
+// Write the hierarchy if it was built from the graph as it is now, or
+// remove a stale file otherwise, so edits since the last build are never
+// answered from it.
+void save_contraction_hierarchy(Graph *graph, Contraction_Hierarchy *ch,
+                                c8 *path) {
+  if (ch->num_nodes == 0 || ch->fingerprint != graph_fingerprint(graph)) {
+    remove(path);
+    return;
+  }
+
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    printf("Error: Cannot write %s.\n", path);
+    return;
+  }
+
+  u32 magic = CH_FILE_MAGIC;
+  b8 ok = ch_write(f, &magic, 1, sizeof magic) &&
+          ch_write(f, &ch->fingerprint, 1, sizeof(u64)) &&
+          ch_write(f, &ch->num_nodes, 1, sizeof(i64)) &&
+          ch_write(f, &ch->num_arcs, 1, sizeof(i64)) &&
+          ch_write(f, &ch->num_shortcuts, 1, sizeof(i64)) &&
+          ch_write(f, ch->rank, ch->num_nodes, sizeof(i64)) &&
+          ch_write(f, ch->arc_a, ch->num_arcs, sizeof(i64)) &&
+          ch_write(f, ch->arc_b, ch->num_arcs, sizeof(i64)) &&
+          ch_write(f, ch->arc_weight, ch->num_arcs, sizeof(f64)) &&
+          ch_write(f, ch->arc_edge, ch->num_arcs, sizeof(i64)) &&
+          ch_write(f, ch->arc_middle, ch->num_arcs, sizeof(i64)) &&
+          ch_write(f, ch->arc_child[0], ch->num_arcs, sizeof(i64)) &&
+          ch_write(f, ch->arc_child[1], ch->num_arcs, sizeof(i64));
+
+  fclose(f);
+
+  if (!ok) {
+    printf("Error: Cannot write %s.\n", path);
+    remove(path);
+  }
+}
+
+// Save the graph and the hierarchy next to it. Saving renumbers the
+// nodes and moves them to whole coordinates, so a hierarchy that was
+// current is built again for the graph as saved, which is the graph the
+// files load back as.
+void save_graph_and_hierarchy(Contraction_Hierarchy *ch, c8 *graph_path,
+                              c8 *ch_path) {
+  b8 current =
+      ch->num_nodes > 0 && ch->fingerprint == graph_fingerprint(&graph);
+
+  if (!save_graph(graph_path))
+    return;
+
+  if (current && ch->fingerprint != graph_fingerprint(&graph))
+    build_contraction_hierarchy(&graph, ch);
+
+  save_contraction_hierarchy(&graph, ch, ch_path);
+}
+
+// Load the hierarchy saved next to the graph. Returns 0 and leaves the
+// hierarchy empty if there is none or it was built from another graph.
+b8 load_contraction_hierarchy(Graph *graph, Contraction_Hierarchy *ch,
+                              c8 *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+
+  u32 magic = 0;
+  u64 fingerprint = 0;
+  i64 num_nodes = 0;
+  i64 num_arcs = 0;
+
+  b8 ok = ch_read(f, &magic, 1, sizeof magic) && magic == CH_FILE_MAGIC &&
+          ch_read(f, &fingerprint, 1, sizeof fingerprint) &&
+          fingerprint == graph_fingerprint(graph) &&
+          ch_read(f, &num_nodes, 1, sizeof num_nodes) &&
+          num_nodes == graph->num_nodes &&
+          ch_read(f, &num_arcs, 1, sizeof num_arcs) && num_arcs >= 0;
+
+  if (ok) {
+    ch_reserve_arcs(ch, num_arcs);
+    ch->rank = resize_array(ch->rank, 0, num_nodes, sizeof(i64));
+
+    ok = ch_read(f, &ch->num_shortcuts, 1, sizeof(i64)) &&
+         ch_read(f, ch->rank, num_nodes, sizeof(i64)) &&
+         ch_read(f, ch->arc_a, num_arcs, sizeof(i64)) &&
+         ch_read(f, ch->arc_b, num_arcs, sizeof(i64)) &&
+         ch_read(f, ch->arc_weight, num_arcs, sizeof(f64)) &&
+         ch_read(f, ch->arc_edge, num_arcs, sizeof(i64)) &&
+         ch_read(f, ch->arc_middle, num_arcs, sizeof(i64)) &&
+         ch_read(f, ch->arc_child[0], num_arcs, sizeof(i64)) &&
+         ch_read(f, ch->arc_child[1], num_arcs, sizeof(i64));
+  }
+
+  fclose(f);
+
+  if (!ok) {
+    ch->num_nodes = 0;
+    ch->num_arcs = 0;
+    return 0;
+  }
+
+  ch->num_nodes = num_nodes;
+  ch->num_arcs = num_arcs;
+  ch->fingerprint = fingerprint;
+  ch->topology_version = graph->topology_version;
+  ch->geometry_version = graph->geometry_version;
+  ch_build_up_index(ch);
+
+  return 1;
+}
+
+/*************/
+/* LANDMARKS */
+/*************/
+
+enum {
+  NUM_LANDMARKS = 8,
+};
+
+// Distances from a few landmark nodes to every node, for the ALT lower
+// bound: for any landmark l, |d(l, dst) - d(l, v)| <= d(v, dst) by the
+// triangle inequality. It needs no geometry, only positive weights.
+// distance holds the landmarks of each node side by side, INFINITY where
+// a landmark cannot reach the node.
+typedef struct {
+  u64 topology_version;
+  u64 geometry_version;
+
+  i64 capacity;
+  i64 num_landmarks;
+  i64 landmarks[NUM_LANDMARKS];
+  f64 *distance;
+
+  Graph_View view;
+  Path_Search searches[MAX_WORKERS];
+} Landmarks;
+
+Landmarks landmarks = {0};
+
+// Full Dijkstra from each landmark in the scratch of the worker, copied
+// into the landmark's column.
+void landmark_task(void *data, i64 worker, i64 begin, i64 end) {
+  Landmarks *lm = data;
+  Path_Search *search = &lm->searches[worker];
+  i64 n = lm->view.num_nodes;
+
+  for (i64 l = begin; l < end; ++l) {
+    search_path_view(&lm->view, search, lm->landmarks[l], -1, NULL, NULL);
+
+    for (i64 i = 0; i < n; ++i)
+      lm->distance[i * NUM_LANDMARKS + l] =
+          search->distance[i] < 0 ? INFINITY : search->distance[i];
+  }
+}
+
+// Landmarks work best far out on the border, behind the nodes they
+// should guide towards. The plane is split into equal angular sectors
+// around the centroid and the node farthest from it in each sector is
+// taken. Their distance arrays are computed in parallel.
+void build_landmarks(Graph *graph, Landmarks *lm, Worker_Pool *pool) {
+  i64 n = graph->num_nodes;
+
+  if (lm->capacity < n) {
+    lm->distance = resize_array(lm->distance, lm->capacity * NUM_LANDMARKS,
+                                n * NUM_LANDMARKS, sizeof(f64));
+    lm->capacity = n;
+  }
+
+  f64 cx = 0;
+  f64 cy = 0;
+  i64 count = 0;
+
+  for (i64 i = 0; i < n; ++i)
+    if (bit_get(graph->node_enabled, i)) {
+      cx += graph->node_x[i];
+      cy += graph->node_y[i];
+      count++;
+    }
+
+  if (count > 0) {
+    cx /= count;
+    cy /= count;
+  }
+
+  f64 farthest[NUM_LANDMARKS];
+
+  for (i64 l = 0; l < NUM_LANDMARKS; ++l) {
+    lm->landmarks[l] = -1;
+    farthest[l] = -1;
+  }
+
+  for (i64 i = 0; i < n; ++i) {
+    if (!bit_get(graph->node_enabled, i))
+      continue;
+
+    f64 dx = graph->node_x[i] - cx;
+    f64 dy = graph->node_y[i] - cy;
+    f64 angle = atan2(dy, dx) + M_PI;
+    i64 l = (i64)(angle / (2 * M_PI) * NUM_LANDMARKS) % NUM_LANDMARKS;
+
+    if (dx * dx + dy * dy > farthest[l]) {
+      farthest[l] = dx * dx + dy * dy;
+      lm->landmarks[l] = i;
+    }
+  }
+
+  // Close up the sectors without nodes
+  lm->num_landmarks = 0;
+  for (i64 l = 0; l < NUM_LANDMARKS; ++l)
+    if (lm->landmarks[l] >= 0)
+      lm->landmarks[lm->num_landmarks++] = lm->landmarks[l];
+
+  for (i64 i = 0; i < n * NUM_LANDMARKS; ++i)
+    lm->distance[i] = INFINITY;
+
+  lm->view = get_graph_view(graph);
+  pool_run(pool, lm->num_landmarks, 1, landmark_task, lm);
+
+  lm->topology_version = graph->topology_version;
+  lm->geometry_version = graph->geometry_version;
+}
+
+b8 landmarks_are_current(Graph *graph, Landmarks *lm) {
+  return lm->topology_version == graph->topology_version &&
+         lm->geometry_version == graph->geometry_version;
+}
+
+// Best triangle inequality bound over the landmarks. If a landmark
+// reaches exactly one of the two nodes they are not connected.
+f64 landmark_heuristic(void *data, i64 node_idx, i64 dst) {
+  Landmarks *lm = data;
+  f64 *from = &lm->distance[node_idx * NUM_LANDMARKS];
+  f64 *to = &lm->distance[dst * NUM_LANDMARKS];
+  f64 bound = 0;
+
+  for (i64 l = 0; l < lm->num_landmarks; ++l) {
+    if ((from[l] == INFINITY) != (to[l] == INFINITY))
+      return INFINITY;
+    if (from[l] == INFINITY)
+      continue;
+
+    f64 diff = fabs(to[l] - from[l]);
+    if (diff > bound)
+      bound = diff;
+  }
+
+  return bound;
+}
+
+void find_shortest_path_alt(Graph *graph, Landmarks *lm, Path_Search *search,
+                            i64 src, i64 dst) {
+  Graph_View view = get_graph_view(graph);
+  search_path_view(&view, search, src, dst, landmark_heuristic, lm);
+}
+
+/********************/
+/* K SHORTEST PATHS */
+/********************/
+
+enum {
+  K_SHORTEST_PATHS = 4,
+};
+
+// Path of Yen's search, its edges from src to dst stored from start in
+// the arena. deviation is the number of leading edges it shares with the
+// path it was spurred from.
+typedef struct {
+  f64 cost;
+  u64 hash;
+  i64 start;
+  i64 length;
+  i64 deviation;
+} Yen_Path;
+
+// Yen's k shortest loopless paths. Every path accepted is the cheapest
+// candidate left, and adds a candidate for each of its nodes, the spur:
+// the same root path up to the spur, then the shortest path from the
+// spur to dst avoiding the root nodes and the next edge of every
+// accepted path sharing that root. Spurs before the deviation of the
+// path would only find candidates already found (Lawler), so they are
+// skipped.
+//
+// All spur searches share one heap and one set of node arrays, reset
+// only where the last search wrote. Blocked nodes and edges are tagged
+// with the number of the spur, so nothing is cleared or allocated per
+// spur. Accepted and candidate paths are runs of edges in one arena.
+typedef struct {
+  i64 capacity;
+  i64 edges_capacity;
+  f64 *distance;
+  i64 *prev_edge;
+  i64 *node_block;
+  i64 *edge_block;
+  i64 block;
+  Heap heap;
+  Index_List touched;
+
+  Index_List arena;
+  Index_List nodes;
+  Index_List same_root;
+  i64 paths_capacity;
+  i64 num_paths;
+  Yen_Path *paths;
+  i64 candidates_capacity;
+  i64 num_candidates;
+  Yen_Path *candidates;
+  Heap candidate_heap;
+
+  i64 num_spur_searches;
+  i64 nodes_expanded;
+} K_Shortest_Paths;
+
+K_Shortest_Paths k_shortest_paths = {0};
+
+void k_shortest_paths_reserve(Graph *graph, K_Shortest_Paths *ksp) {
+  i64 n = graph->num_nodes;
+  i64 m = graph->num_edges;
+
+  heap_reserve(&ksp->heap, n);
+
+  if (n > ksp->capacity) {
+    ksp->distance = resize_array(ksp->distance, 0, n, sizeof(f64));
+    ksp->prev_edge = resize_array(ksp->prev_edge, ksp->capacity, n,
+                                  sizeof(i64));
+    ksp->node_block = resize_array(ksp->node_block, ksp->capacity, n,
+                                   sizeof(i64));
+    ksp->capacity = n;
+
+    for (i64 i = 0; i < n; ++i)
+      ksp->distance[i] = INFINITY;
+    ksp->touched.size = 0;
+  }
+
+  if (m > ksp->edges_capacity) {
+    ksp->edge_block = resize_array(ksp->edge_block, ksp->edges_capacity, m,
+                                   sizeof(i64));
+    ksp->edges_capacity = m;
+  }
+}
+
+// Shortest path from the spur to dst around the blocked nodes and edges,
+// by A* when edges are Euclidean. Returns its cost, INFINITY if there is
+// none, and leaves the path in prev_edge.
+f64 yen_spur_search(Graph_View *view, K_Shortest_Paths *ksp, i64 spur,
+                    i64 dst) {
+  for (i64 k = 0; k < ksp->touched.size; ++k)
+    ksp->distance[ksp->touched.items[k]] = INFINITY;
+  ksp->touched.size = 0;
+  heap_clear(&ksp->heap);
+
+  ksp->distance[spur] = 0;
+  ksp->prev_edge[spur] = -1;
+  index_list_push(&ksp->touched, spur);
+  heap_push(&ksp->heap, spur, 0);
+  ksp->num_spur_searches++;
+
+  while (ksp->heap.size > 0) {
+    f64 key;
+    i64 node_idx = heap_pop(&ksp->heap, &key);
+    f64 dist = ksp->distance[node_idx];
+    ksp->nodes_expanded++;
+
+    if (node_idx == dst)
+      return dist;
+
+    for (i64 k = view->offsets[node_idx]; k < view->offsets[node_idx + 1];
+         ++k) {
+      i64 edge_idx = view->edge_ids[k];
+      i64 next_idx = view->neighbors[k];
+
+      if (ksp->edge_block[edge_idx] == ksp->block ||
+          ksp->node_block[next_idx] == ksp->block)
+        continue;
+
+      f64 next_dist = dist + view->edge_cost[edge_idx];
+      if (next_dist >= ksp->distance[next_idx])
+        continue;
+
+      if (ksp->distance[next_idx] == INFINITY)
+        index_list_push(&ksp->touched, next_idx);
+
+      ksp->distance[next_idx] = next_dist;
+      ksp->prev_edge[next_idx] = edge_idx;
+
+      if (!view->weighted)
+        next_dist += euclidean_heuristic(view, next_idx, dst);
+      heap_push(&ksp->heap, next_idx, next_dist);
+    }
+  }
+
+  return INFINITY;
+}
+
+b8 yen_same_path(K_Shortest_Paths *ksp, Yen_Path *a, Yen_Path *b) {
+  if (a->hash != b->hash || a->length != b->length)
+    return 0;
+
+  for (i64 i = 0; i < a->length; ++i)
+    if (ksp->arena.items[a->start + i] != ksp->arena.items[b->start + i])
+      return 0;
+
+  return 1;
+}
+
+// Add the root edges followed by the path the last spur search found, at
+// the end of the arena, unless the same path is a candidate already.
+void yen_add_candidate(Graph_View *view, K_Shortest_Paths *ksp,
+                       i64 root_start, i64 root_length, f64 root_cost,
+                       i64 spur, i64 dst, f64 spur_cost) {
+  Index_List *arena = &ksp->arena;
+  i64 start = arena->size;
+
+  for (i64 i = 0; i < root_length; ++i)
+    index_list_push(arena, arena->items[root_start + i]);
+
+  // The spur path is followed back from dst, so reverse it in place
+  for (i64 node_idx = dst; node_idx != spur;) {
+    i64 edge_idx = ksp->prev_edge[node_idx];
+    index_list_push(arena, edge_idx);
+    node_idx = view->edge_src[edge_idx] == node_idx ? view->edge_dst[edge_idx]
+                                                    : view->edge_src[edge_idx];
+  }
+
+  for (i64 i = start + root_length, j = arena->size - 1; i < j; ++i, --j) {
+    i64 t = arena->items[i];
+    arena->items[i] = arena->items[j];
+    arena->items[j] = t;
+  }
+
+  Yen_Path path = {
+      .cost = root_cost + spur_cost,
+      .hash = 0,
+      .start = start,
+      .length = arena->size - start,
+      .deviation = root_length,
+  };
+
+  for (i64 i = start; i < arena->size; ++i)
+    path.hash = fingerprint_mix(path.hash, arena->items[i]);
+
+  for (i64 c = 0; c < ksp->num_candidates; ++c)
+    if (yen_same_path(ksp, &ksp->candidates[c], &path)) {
+      arena->size = start;
+      return;
+    }
+
+  if (ksp->num_candidates == ksp->candidates_capacity) {
+    i64 capacity = ksp->candidates_capacity > 0
+                       ? ksp->candidates_capacity * 2
+                       : 16;
+    ksp->candidates = resize_array(ksp->candidates, ksp->candidates_capacity,
+                                   capacity, sizeof(Yen_Path));
+    ksp->candidates_capacity = capacity;
+    heap_reserve(&ksp->candidate_heap, capacity);
+  }
+
+  ksp->candidates[ksp->num_candidates] = path;
+  heap_push(&ksp->candidate_heap, ksp->num_candidates, path.cost);
+  ksp->num_candidates++;
+}
+
+// Spur off every node of the last accepted path from its deviation on.
+void yen_spur_last_path(Graph_View *view, K_Shortest_Paths *ksp, i64 src,
+                        i64 dst) {
+  Yen_Path last = ksp->paths[ksp->num_paths - 1];
+  i64 *arena = ksp->arena.items;
+
+  ksp->nodes.size = 0;
+  index_list_push(&ksp->nodes, src);
+  for (i64 i = 0; i < last.length; ++i) {
+    i64 edge_idx = arena[last.start + i];
+    i64 node_idx = ksp->nodes.items[i];
+    index_list_push(&ksp->nodes, view->edge_src[edge_idx] == node_idx
+                                     ? view->edge_dst[edge_idx]
+                                     : view->edge_src[edge_idx]);
+  }
+
+  // Accepted paths sharing the root up to the current spur
+  ksp->same_root.size = 0;
+  for (i64 p = 0; p < ksp->num_paths; ++p)
+    index_list_push(&ksp->same_root, p);
+
+  f64 root_cost = 0;
+
+  for (i64 i = 0; i < last.length; ++i) {
+    if (i > 0) {
+      i64 edge_idx = arena[last.start + i - 1];
+      i64 size = 0;
+
+      for (i64 k = 0; k < ksp->same_root.size; ++k) {
+        Yen_Path *p = &ksp->paths[ksp->same_root.items[k]];
+        if (p->length >= i && arena[p->start + i - 1] == edge_idx)
+          ksp->same_root.items[size++] = ksp->same_root.items[k];
+      }
+
+      ksp->same_root.size = size;
+      root_cost += view->edge_cost[edge_idx];
+    }
+
+    if (i < last.deviation)
+      continue;
+
+    ksp->block++;
+
+    for (i64 j = 0; j < i; ++j)
+      ksp->node_block[ksp->nodes.items[j]] = ksp->block;
+
+    for (i64 k = 0; k < ksp->same_root.size; ++k) {
+      Yen_Path *p = &ksp->paths[ksp->same_root.items[k]];
+      if (p->length > i)
+        ksp->edge_block[arena[p->start + i]] = ksp->block;
+    }
+
+    i64 spur = ksp->nodes.items[i];
+    f64 spur_cost = yen_spur_search(view, ksp, spur, dst);
+
+    if (spur_cost < INFINITY) {
+      yen_add_candidate(view, ksp, last.start, i, root_cost, spur, dst,
+                        spur_cost);
+      arena = ksp->arena.items;
+    }
+  }
+}
+
+// Up to k loopless paths from src to dst, cheapest first, into paths.
+void find_k_shortest_paths(Graph *graph, K_Shortest_Paths *ksp, i64 src,
+                           i64 dst, i64 k) {
+  Graph_View view = get_graph_view(graph);
+
+  k_shortest_paths_reserve(graph, ksp);
+  heap_clear(&ksp->candidate_heap);
+  ksp->arena.size = 0;
+  ksp->num_paths = 0;
+  ksp->num_candidates = 0;
+  ksp->num_spur_searches = 0;
+  ksp->nodes_expanded = 0;
+
+  if (!validate_node(graph, src) || !validate_node(graph, dst) ||
+      src == dst || view.component[src] != view.component[dst])
+    return;
+
+  // The shortest path is the first candidate, spurred from src with
+  // nothing blocked
+  ksp->block++;
+  f64 cost = yen_spur_search(&view, ksp, src, dst);
+  if (cost < INFINITY)
+    yen_add_candidate(&view, ksp, 0, 0, 0, src, dst, cost);
+
+  while (ksp->num_paths < k && ksp->candidate_heap.size > 0) {
+    f64 key;
+    i64 c = heap_pop(&ksp->candidate_heap, &key);
+
+    if (ksp->num_paths == ksp->paths_capacity) {
+      i64 capacity = ksp->paths_capacity > 0 ? ksp->paths_capacity * 2 : 8;
+      ksp->paths = resize_array(ksp->paths, ksp->paths_capacity, capacity,
+                                sizeof(Yen_Path));
+      ksp->paths_capacity = capacity;
+    }
+
+    ksp->paths[ksp->num_paths++] = ksp->candidates[c];
+
+    if (ksp->num_paths < k)
+      yen_spur_last_path(&view, ksp, src, dst);
+  }
+}
+
+// Paths go into graph->path from dst back to src like a single path.
+// Only their nodes are highlighted, the edges are told apart by color.
+void highlight_k_shortest_paths(Graph *graph, K_Shortest_Paths *ksp, i64 src,
+                                i64 dst, i64 k) {
+  find_k_shortest_paths(graph, ksp, src, dst, k);
+
+  printf("%s: %lld paths, %lld spur searches, %lld nodes expanded\n",
+         path_mode_names[PATH_K_SHORTEST], ksp->num_paths,
+         ksp->num_spur_searches, ksp->nodes_expanded);
+
+  for (i64 p = 0; p < ksp->num_paths; ++p) {
+    Yen_Path *path = &ksp->paths[p];
+
+    for (i64 i = path->length - 1; i >= 0; --i) {
+      i64 edge_idx = ksp->arena.items[path->start + i];
+      push_path_edge(graph, edge_idx);
+      bit_set(graph->node_highlight, graph->edge_src[edge_idx], 1);
+      bit_set(graph->node_highlight, graph->edge_dst[edge_idx], 1);
+    }
+
+    finish_path(graph);
+    printf("  %lld: cost %g, %lld edges\n", p + 1, path->cost, path->length);
+  }
+}
+
+b8 path_is_current(Graph *graph, i64 src, i64 dst, i64 mode) {
+  return graph->path_src == src && graph->path_dst == dst &&
+         graph->path_mode == mode &&
+         graph->path_topology_version == graph->topology_version &&
+         graph->path_geometry_version == graph->geometry_version;
+}
+
+// Counters of the last query, from wherever the mode keeps them.
+void print_path_stats(i64 mode) {
+  if (mode == PATH_INCREMENTAL)
+    printf("%s: %lld nodes settled by the last update\n",
+           path_mode_names[mode], path_tree.nodes_repaired);
+  else if (mode == PATH_BIDIRECTIONAL)
+    printf("%s: %lld + %lld nodes settled, %lld + %lld edges relaxed\n",
+           path_mode_names[mode], path_search.nodes_expanded,
+           path_search_reverse.nodes_expanded, path_search.edges_relaxed,
+           path_search_reverse.edges_relaxed);
+  else if (mode == PATH_DELTA_STEPPING)
+    printf("%s: %lld nodes settled in %lld rounds, %lld edges relaxed, "
+           "delta %g\n",
+           path_mode_names[mode], delta_stepping.nodes_settled,
+           delta_stepping.num_rounds, delta_stepping.edges_relaxed,
+           delta_stepping.delta);
+  else if (mode == PATH_CONTRACTION)
+    printf("%s: %lld nodes settled\n", path_mode_names[mode],
+           path_search.nodes_expanded);
+  else
+    printf("%s: %lld nodes expanded, %lld edges relaxed\n",
+           path_mode_names[mode], path_search.nodes_expanded,
+           path_search.edges_relaxed);
+}
+
+void highlight_path(Graph *graph, i64 src, i64 dst, i64 mode) {
+  // Reruns after nodes moved find the same nodes unreachable, so the
+  // messages come once per query and topology
+  b8 report = graph->path_src != src || graph->path_dst != dst ||
+              graph->path_mode != mode ||
+              graph->path_topology_version != graph->topology_version;
+
+  clear_node_edge_highlight(graph);
+  clear_paths(graph);
+  graph->path_src = src;
+  graph->path_dst = dst;
+  graph->path_mode = mode;
+  graph->path_topology_version = graph->topology_version;
+  graph->path_geometry_version = graph->geometry_version;
+
+  if (!validate_node(graph, src) || !validate_node(graph, dst)) {
+    if (report)
+      printf("Invalid source or destination node index.\n");
+    return;
+  }
+
+  // Set initial conditions
+  bit_set(graph->node_highlight, src, 1);
+  bit_set(graph->node_highlight, dst, 1);
+
+  // Nodes in different components have no path, skip the search
+  if (!nodes_connected(graph, src, dst)) {
+    if (report)
+      printf("Path not found, the nodes are not connected\n");
+    return;
+  }
+
+  if (mode == PATH_K_SHORTEST) {
+    highlight_k_shortest_paths(graph, &k_shortest_paths, src, dst,
+                               K_SHORTEST_PATHS);
+    return;
+  }
+
+  switch (mode) {
+  case PATH_INCREMENTAL:
+    if (!path_tree_is_current(graph, &path_tree, src))
+      build_path_tree(graph, &path_tree, src);
+    break;
+  case PATH_ASTAR:
+    find_shortest_path_astar(graph, &path_search, src, dst);
+    break;
+  case PATH_BIDIRECTIONAL:
+    find_shortest_path_bidirectional(graph, &path_search,
+                                     &path_search_reverse, src, dst);
+    break;
+  case PATH_DELTA_STEPPING:
+    find_shortest_paths_delta(graph, &delta_stepping, &worker_pool, src,
+                              delta_stepping_delta);
+    break;
+  case PATH_CONTRACTION:
+    if (!contraction_hierarchy_is_current(graph, &contraction_hierarchy)) {
+      build_contraction_hierarchy(graph, &contraction_hierarchy);
+      if (PRINT_ENGINE_STATS)
+        printf("%s: built with %lld shortcuts\n", path_mode_names[mode],
+               contraction_hierarchy.num_shortcuts);
+    }
+    find_shortest_path_ch(graph, &contraction_hierarchy, &ch_search,
+                          &ch_search_reverse, &path_search, src, dst);
+    break;
+  case PATH_LANDMARKS:
+    if (!landmarks_are_current(graph, &landmarks))
+      build_landmarks(graph, &landmarks, &worker_pool);
+    find_shortest_path_alt(graph, &landmarks, &path_search, src, dst);
+    break;
+  default:
+    find_shortest_path(graph, &path_search, src, dst);
+  }
+
+  if (PRINT_ENGINE_STATS)
+    print_path_stats(mode);
+
+  f64 *distance = path_search.distance;
+  i64 *prev_edge = path_search.prev_edge;
+
+  if (mode == PATH_INCREMENTAL) {
+    distance = path_tree.distance;
+    prev_edge = path_tree.prev_edge;
+  } else if (mode == PATH_DELTA_STEPPING) {
+    distance = delta_stepping.distance;
+    prev_edge = delta_stepping.prev_edge;
+  }
+
+  // If no path was found, alert the user
+  if (distance[dst] < 0 || distance[dst] == INFINITY) {
+    if (report)
+      printf("Path not found\n");
+    return;
+  }
+
+  // Follow the predecessor edges from destination back to source
+  for (i64 curr_node_idx = dst; curr_node_idx != src;) {
+    i64 edge_idx = prev_edge[curr_node_idx];
+
+    if (edge_idx < 0) {
+      if (report)
+        printf("Path is broken by a zero-length edge\n");
+      return;
+    }
+
+    push_path_edge(graph, edge_idx);
+
+    curr_node_idx = (graph->edge_src[edge_idx] == curr_node_idx)
+                        ? graph->edge_dst[edge_idx]
+                        : graph->edge_src[edge_idx];
+
+    // Highlight the node and edge as part of the path
+    bit_set(graph->node_highlight, curr_node_idx, 1);
+    bit_set(graph->edge_highlight, edge_idx, 1);
+  }
+
+  finish_path(graph);
+}
+
+/****************/
+/* PATH QUERIES */
+/****************/
+
+enum {
+  PATH_CACHE_SIZE = 8,
+};
+
+typedef struct {
+  i64 src;
+  i64 dst;
+} Path_Query;
+
+// Shortest path trees of the most recently queried sources. A tree is
+// reused while its version tags match the graph, otherwise its slot is
+// rebuilt. When every slot is taken the least recently used one goes.
+typedef struct {
+  Path_Tree trees[PATH_CACHE_SIZE];
+  u64 last_used[PATH_CACHE_SIZE];
+  u64 clock;
+
+  i64 hits;
+  i64 misses;
+} Path_Cache;
+
+Path_Cache path_cache = {0};
+
+Path_Tree *path_cache_get(Graph *graph, Path_Cache *cache, i64 src) {
+  i64 slot = 0;
+
+  for (i64 i = 0; i < PATH_CACHE_SIZE; ++i) {
+    Path_Tree *tree = &cache->trees[i];
+
+    if (tree->topology_version != 0 && tree->source == src) {
+      slot = i;
+      break;
+    }
+    if (cache->last_used[i] < cache->last_used[slot])
+      slot = i;
+  }
+
+  Path_Tree *tree = &cache->trees[slot];
+  cache->last_used[slot] = ++cache->clock;
+
+  if (path_tree_is_current(graph, tree, src)) {
+    cache->hits++;
+    return tree;
+  }
+
+  cache->misses++;
+  build_path_tree(graph, tree, src);
+  return tree;
+}
+
+// Answer a batch of queries into caller-owned buffers. distances[i] gets
+// the length of the shortest path of queries[i], or INFINITY if there is
+// none or an endpoint is invalid. Paths are written as node lists from src
+// to dst, one after another, with path i in path_nodes[path_offsets[i]]
+// to path_nodes[path_offsets[i + 1]], so path_offsets needs num_queries + 1
+// entries. Returns the number of path nodes of the whole batch. Paths not
+// fitting into path_capacity are skipped, so if the result is larger the
+// caller can grow path_nodes and query again, the trees are still cached.
+// path_nodes can be NULL with path_capacity 0 to get distances only.
+i64 find_shortest_paths(Graph *graph, Path_Cache *cache, Path_Query *queries,
+                        i64 num_queries, f64 *distances, i64 *path_offsets,
+                        i64 *path_nodes, i64 path_capacity) {
+  i64 path_size = 0;
+
+  for (i64 q = 0; q < num_queries; ++q) {
+    i64 src = queries[q].src;
+    i64 dst = queries[q].dst;
+
+    path_offsets[q] = path_size;
+    distances[q] = INFINITY;
+
+    if (!validate_node(graph, src) || !validate_node(graph, dst) ||
+        !nodes_connected(graph, src, dst))
+      continue;
+
+    Path_Tree *tree = path_cache_get(graph, cache, src);
+    distances[q] = tree->distance[dst];
+
+    if (tree->distance[dst] == INFINITY)
+      continue;
+
+    i64 num_path_nodes = 1;
+    for (i64 curr = dst; curr != src; ++num_path_nodes) {
+      i64 edge_idx = tree->prev_edge[curr];
+      curr = graph->edge_src[edge_idx] == curr ? graph->edge_dst[edge_idx]
+                                               : graph->edge_src[edge_idx];
+    }
+
+    if (path_size + num_path_nodes <= path_capacity) {
+      // Walk back from the destination, filling the list from its end
+      i64 i = path_size + num_path_nodes - 1;
+      path_nodes[i] = dst;
+
+      for (i64 curr = dst; curr != src;) {
+        i64 edge_idx = tree->prev_edge[curr];
+        curr = graph->edge_src[edge_idx] == curr ? graph->edge_dst[edge_idx]
+                                                 : graph->edge_src[edge_idx];
+        path_nodes[--i] = curr;
+      }
+    }
+
+    path_size += num_path_nodes;
+  }
+
+  path_offsets[num_queries] = path_size;
+  return path_size;
+}
+
+/*************************/
+/* PARALLEL PATH QUERIES */
+/*************************/
+
+// Scratch of one worker. Paths found by the worker are appended to its
+// path buffer and gathered into the caller's buffer once all are done.
+typedef struct {
+  Path_Search search;
+  i64 path_capacity;
+  i64 path_size;
+  i64 *path;
+} Path_Worker;
+
+typedef struct {
+  Path_Worker workers[MAX_WORKERS];
+
+  // Where each query left its path, in the buffer of query_worker
+  i64 queries_capacity;
+  i64 *query_worker;
+  i64 *query_start;
+
+  // The batch being run
+  Graph_View view;
+  Path_Query *queries;
+  f64 *distances;
+  i64 *path_sizes;
+} Path_Batch;
+
+Path_Batch path_batch = {0};
+
+void path_batch_task(void *data, i64 worker, i64 begin, i64 end) {
+  Path_Batch *batch = data;
+  Graph_View *view = &batch->view;
+  Path_Worker *scratch = &batch->workers[worker];
+  Path_Search *search = &scratch->search;
+
+  for (i64 q = begin; q < end; ++q) {
+    i64 src = batch->queries[q].src;
+    i64 dst = batch->queries[q].dst;
+
+    batch->distances[q] = INFINITY;
+    batch->path_sizes[q] = 0;
+
+    if (src < 0 || src >= view->num_nodes || dst < 0 ||
+        dst >= view->num_nodes || !bit_get(view->node_enabled, src) ||
+        !bit_get(view->node_enabled, dst) ||
+        view->component[src] != view->component[dst])
+      continue;
+
+    search_path_view(view, search, src, dst,
+                     view->weighted ? NULL : euclidean_heuristic, view);
+
+    if (search->distance[dst] < 0)
+      continue;
+
+    i64 num_path_nodes = 1;
+    for (i64 curr = dst; curr != src; ++num_path_nodes) {
+      i64 edge_idx = search->prev_edge[curr];
+      curr = view->edge_src[edge_idx] == curr ? view->edge_dst[edge_idx]
+                                              : view->edge_src[edge_idx];
+    }
+
+    if (scratch->path_size + num_path_nodes > scratch->path_capacity) {
+      i64 capacity = scratch->path_capacity > 0 ? scratch->path_capacity : 256;
+      while (capacity < scratch->path_size + num_path_nodes)
+        capacity *= 2;
+
+      scratch->path = resize_array(scratch->path, scratch->path_capacity,
+                                   capacity, sizeof(i64));
+      scratch->path_capacity = capacity;
+    }
+
+    // Walk back from the destination, filling the list from its end
+    i64 i = scratch->path_size + num_path_nodes - 1;
+    scratch->path[i] = dst;
+
+    for (i64 curr = dst; curr != src;) {
+      i64 edge_idx = search->prev_edge[curr];
+      curr = view->edge_src[edge_idx] == curr ? view->edge_dst[edge_idx]
+                                              : view->edge_src[edge_idx];
+      scratch->path[--i] = curr;
+    }
+
+    batch->distances[q] = search->distance[dst];
+    batch->path_sizes[q] = num_path_nodes;
+    batch->query_worker[q] = worker;
+    batch->query_start[q] = scratch->path_size;
+    scratch->path_size += num_path_nodes;
+  }
+}
+
+// Same contract as find_shortest_paths, with the queries spread over the
+// pool. Each one is a separate A* search in the scratch of the worker
+// that takes it, on a view of the graph, so nothing shared is written
+// while the workers run. There is no tree cache, so this pays off for
+// many distinct sources rather than repeated ones.
+i64 find_shortest_paths_parallel(Graph *graph, Worker_Pool *pool,
+                                 Path_Batch *batch, Path_Query *queries,
+                                 i64 num_queries, f64 *distances,
+                                 i64 *path_offsets, i64 *path_nodes,
+                                 i64 path_capacity) {
+  if (batch->queries_capacity < num_queries) {
+    batch->query_worker = resize_array(batch->query_worker,
+                                       batch->queries_capacity, num_queries,
+                                       sizeof(i64));
+    batch->query_start = resize_array(
+        batch->query_start, batch->queries_capacity, num_queries, sizeof(i64));
+    batch->queries_capacity = num_queries;
+  }
+
+  for (i64 i = 0; i < MAX_WORKERS; ++i)
+    batch->workers[i].path_size = 0;
+
+  batch->view = get_graph_view(graph);
+  batch->queries = queries;
+  batch->distances = distances;
+  batch->path_sizes = path_offsets;
+
+  pool_run(pool, num_queries, 1, path_batch_task, batch);
+
+  // Turn path sizes into offsets and gather the paths that fit
+  i64 path_size = 0;
+
+  for (i64 q = 0; q < num_queries; ++q) {
+    i64 num_path_nodes = path_offsets[q];
+    path_offsets[q] = path_size;
+
+    if (num_path_nodes > 0 && path_size + num_path_nodes <= path_capacity) {
+      Path_Worker *scratch = &batch->workers[batch->query_worker[q]];
+      memcpy(path_nodes + path_size, scratch->path + batch->query_start[q],
+             num_path_nodes * sizeof(i64));
+    }
+
+    path_size += num_path_nodes;
+  }
+
+  path_offsets[num_queries] = path_size;
+  return path_size;
+}
+
+/*******************/
+/* SPANNING FOREST */
+/*******************/
+
+enum {
+  BORUVKA_MIN_EDGES = 1 << 16,
+  BORUVKA_CHUNK = 1024,
+};
+
+typedef struct {
+  f64 cost;
+  i64 edge;
+} Forest_Edge;
+
+// Minimum spanning forest of the live edges under the current edge
+// costs, one tree per connected component. Ties are broken by edge slot,
+// so the order is total and Kruskal and Borůvka pick the same edges.
+typedef struct {
+  u64 topology_version;
+  u64 geometry_version;
+
+  Index_List edges;
+  i64 num_trees;
+  f64 total_cost;
+  i64 num_rounds;
+
+  Components sets;
+
+  // Kruskal: live edges sorted by cost
+  i64 order_capacity;
+  Forest_Edge *order;
+  Forest_Edge *order_scratch;
+
+  // Borůvka: the set of every node as of the round start, and the
+  // cheapest edge leaving each set, indexed by node slot
+  i64 nodes_capacity;
+  i64 *component;
+  i64 *cheapest;
+  Index_List roots;
+  Graph_View view;
+} Spanning_Forest;
+
+Spanning_Forest spanning_forest = {0};
+
+b8 forest_edge_less(f64 *cost, i64 a, i64 b) {
+  return cost[a] < cost[b] || (cost[a] == cost[b] && a < b);
+}
+
+u64 forest_edge_key(Forest_Edge *item) {
+  u64 key;
+  memcpy(&key, &item->cost, sizeof key);
+  return key;
+}
+
+// Stable LSD radix sort by cost, a byte per pass. Costs are never
+// negative, so their bits sort like the numbers. Items come in slot
+// order, which stability keeps for equal costs. Passes where every item
+// has the same byte are skipped.
+void sort_forest_edges(Forest_Edge *items, Forest_Edge *scratch, i64 n) {
+  for (i64 shift = 0; shift < 64; shift += 8) {
+    i64 offsets[257] = {0};
+
+    for (i64 i = 0; i < n; ++i)
+      offsets[((forest_edge_key(&items[i]) >> shift) & 255) + 1]++;
+
+    b8 skip = 0;
+    for (i64 d = 0; d < 256; ++d)
+      if (offsets[d + 1] == n)
+        skip = 1;
+    if (skip)
+      continue;
+
+    for (i64 d = 0; d < 256; ++d)
+      offsets[d + 1] += offsets[d];
+
+    for (i64 i = 0; i < n; ++i)
+      scratch[offsets[(forest_edge_key(&items[i]) >> shift) & 255]++] =
+          items[i];
+
+    memcpy(items, scratch, n * sizeof(Forest_Edge));
+  }
+}
+
+// Put every live node in a set of its own.
+void spanning_forest_reset(Graph *graph, Spanning_Forest *forest) {
+  Components *sets = &forest->sets;
+  components_reserve(sets, graph->num_nodes);
+
+  sets->num_components = 0;
+  for (i64 i = 0; i < graph->num_nodes; ++i)
+    if (bit_get(graph->node_enabled, i))
+      component_add_node(sets, i);
+
+  forest->edges.size = 0;
+  forest->total_cost = 0;
+  forest->num_rounds = 0;
+}
+
+void spanning_forest_finish(Graph *graph, Spanning_Forest *forest) {
+  forest->num_trees = forest->sets.num_components;
+  forest->topology_version = graph->topology_version;
+  forest->geometry_version = graph->geometry_version;
+}
+
+// Join the sets of the edge if it links two, returns whether it did.
+b8 spanning_forest_add(Spanning_Forest *forest, i64 src, i64 dst,
+                       i64 edge_idx, f64 cost) {
+  i64 a = find_component(&forest->sets, src);
+  i64 b = find_component(&forest->sets, dst);
+  if (a == b)
+    return 0;
+
+  union_components(&forest->sets, a, b);
+  index_list_push(&forest->edges, edge_idx);
+  forest->total_cost += cost;
+
+  return 1;
+}
+
+// Sort the edges once, then take each one that joins two trees.
+void kruskal_spanning_forest(Graph *graph, Spanning_Forest *forest) {
+  f64 *cost = get_edge_costs(graph);
+  spanning_forest_reset(graph, forest);
+
+  if (forest->order_capacity < graph->num_edges) {
+    forest->order = resize_array(forest->order, 0, graph->num_edges,
+                                 sizeof(Forest_Edge));
+    forest->order_scratch = resize_array(
+        forest->order_scratch, 0, graph->num_edges, sizeof(Forest_Edge));
+    forest->order_capacity = graph->num_edges;
+  }
+
+  i64 num_order = 0;
+  for (i64 i = 0; i < graph->num_edges; ++i)
+    if (adjacency_includes(graph, i))
+      forest->order[num_order++] = (Forest_Edge){cost[i], i};
+
+  sort_forest_edges(forest->order, forest->order_scratch, num_order);
+
+  i64 num_forest_edges = graph->nodes_alive - 1;
+
+  for (i64 k = 0; k < num_order && forest->edges.size < num_forest_edges;
+       ++k) {
+    i64 e = forest->order[k].edge;
+    spanning_forest_add(forest, graph->edge_src[e], graph->edge_dst[e], e,
+                        forest->order[k].cost);
+  }
+
+  spanning_forest_finish(graph, forest);
+}
+
+// Lower the cheapest edge of a set, racing the other workers.
+void boruvka_offer(i64 *cheapest, f64 *cost, i64 edge_idx) {
+  i64 old = __atomic_load_n(cheapest, __ATOMIC_RELAXED);
+
+  while (old < 0 || forest_edge_less(cost, edge_idx, old))
+    if (__atomic_compare_exchange_n(cheapest, &old, edge_idx, 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return;
+}
+
+// Every node offers its edges leaving its set to that set.
+void boruvka_cheapest_task(void *data, i64 worker, i64 begin, i64 end) {
+  Spanning_Forest *forest = data;
+  Graph_View *view = &forest->view;
+
+  for (i64 v = begin; v < end; ++v) {
+    if (!bit_get(view->node_enabled, v))
+      continue;
+
+    i64 c = forest->component[v];
+
+    for (i64 k = view->offsets[v]; k < view->offsets[v + 1]; ++k)
+      if (forest->component[view->neighbors[k]] != c)
+        boruvka_offer(&forest->cheapest[c], view->edge_cost,
+                      view->edge_ids[k]);
+  }
+}
+
+// The sets were merged through their old roots, which point straight at
+// the new ones by now.
+void boruvka_relabel_task(void *data, i64 worker, i64 begin, i64 end) {
+  Spanning_Forest *forest = data;
+
+  for (i64 v = begin; v < end; ++v)
+    if (bit_get(forest->view.node_enabled, v))
+      forest->component[v] = forest->sets.parent[forest->component[v]];
+}
+
+// Each round every tree takes its cheapest leaving edge, which at least
+// halves the number of trees. The scans over nodes run on the pool, the
+// joins run on the calling thread over the few trees left.
+void boruvka_spanning_forest(Graph *graph, Spanning_Forest *forest,
+                             Worker_Pool *pool) {
+  forest->view = get_graph_view(graph);
+  spanning_forest_reset(graph, forest);
+
+  i64 n = graph->num_nodes;
+
+  if (forest->nodes_capacity < n) {
+    forest->component = resize_array(forest->component, 0, n, sizeof(i64));
+    forest->cheapest = resize_array(forest->cheapest, 0, n, sizeof(i64));
+    forest->nodes_capacity = n;
+  }
+
+  forest->roots.size = 0;
+  for (i64 i = 0; i < n; ++i)
+    if (bit_get(graph->node_enabled, i)) {
+      forest->component[i] = i;
+      forest->cheapest[i] = -1;
+      index_list_push(&forest->roots, i);
+    }
+
+  for (;;) {
+    pool_run(pool, n, BORUVKA_CHUNK, boruvka_cheapest_task, forest);
+
+    // Both ends of an edge may pick it, only the first one joins
+    i64 joined = 0;
+    for (i64 k = 0; k < forest->roots.size; ++k) {
+      i64 e = forest->cheapest[forest->roots.items[k]];
+      if (e >= 0)
+        joined += spanning_forest_add(forest, graph->edge_src[e],
+                                      graph->edge_dst[e], e,
+                                      forest->view.edge_cost[e]);
+    }
+
+    forest->num_rounds++;
+    if (joined == 0)
+      break;
+
+    // Point the old roots at the new ones and keep the new ones
+    i64 size = 0;
+    for (i64 k = 0; k < forest->roots.size; ++k) {
+      i64 r = forest->roots.items[k];
+
+      if (find_component(&forest->sets, r) == r) {
+        forest->cheapest[r] = -1;
+        forest->roots.items[size++] = r;
+      }
+    }
+    forest->roots.size = size;
+
+    pool_run(pool, n, BORUVKA_CHUNK, boruvka_relabel_task, forest);
+  }
+
+  spanning_forest_finish(graph, forest);
+}
+
+// Borůvka pays off once there are enough edges to split between workers.
+void build_spanning_forest(Graph *graph, Spanning_Forest *forest,
+                           Worker_Pool *pool) {
+  if (pool->num_workers > 1 && graph->edges_alive >= BORUVKA_MIN_EDGES)
+    boruvka_spanning_forest(graph, forest, pool);
+  else
+    kruskal_spanning_forest(graph, forest);
+}
+
+b8 spanning_forest_is_current(Graph *graph, Spanning_Forest *forest) {
+  return forest->topology_version == graph->topology_version &&
+         forest->geometry_version == graph->geometry_version;
+}
+
+// Show the forest in place of the path. The path is dropped, so it is
+// highlighted again once the forest is hidden.
+void highlight_spanning_forest(Graph *graph, Spanning_Forest *forest,
+                               Worker_Pool *pool) {
+  clear_node_edge_highlight(graph);
+  clear_paths(graph);
+  graph->path_topology_version = 0;
+
+  if (!spanning_forest_is_current(graph, forest))
+    build_spanning_forest(graph, forest, pool);
+
+  for (i64 k = 0; k < forest->edges.size; ++k)
+    bit_set(graph->edge_highlight, forest->edges.items[k], 1);
+
+  if (PRINT_ENGINE_STATS)
+    printf("Spanning forest: %lld edges in %lld trees, total cost %g\n",
+           forest->edges.size, forest->num_trees, forest->total_cost);
+}
+
+/***************/
+/* BETWEENNESS */
+/***************/
+
+enum {
+  BETWEENNESS_EXACT_LIMIT = 2048,
+  BETWEENNESS_SAMPLES = 256,
+  BETWEENNESS_CHUNK = 1024,
+};
+
+// Scratch of one worker running Brandes' algorithm, with its own
+// centrality sums. distance is INFINITY for nodes not reached yet, and
+// is reset after each source only where it was set.
+typedef struct {
+  i64 capacity;
+  Heap heap;
+  f64 *distance;
+  f64 *sigma;
+  f64 *delta;
+  i64 *order;
+  f64 *centrality;
+} Betweenness_Worker;
+
+// Betweenness centrality of every node slot: the number of shortest
+// paths between other nodes through it, split evenly between ties,
+// under the current edge costs. In sampled mode only some sources are
+// run and the sums are scaled up, which estimates the same values.
+typedef struct {
+  u64 topology_version;
+  u64 geometry_version;
+
+  i64 capacity;
+  f64 *centrality;
+  f64 max_centrality;
+
+  Index_List sources;
+  b8 sampled;
+  f64 scale;
+  u64 seed;
+
+  Graph_View view;
+  i64 num_workers;
+  Betweenness_Worker workers[MAX_WORKERS];
+} Betweenness;
+
+Betweenness betweenness = {.seed = 0x2545f4914f6cdd1dull};
+
+void betweenness_worker_reserve(Betweenness_Worker *w, i64 num_nodes) {
+  heap_reserve(&w->heap, num_nodes);
+
+  if (num_nodes <= w->capacity)
+    return;
+
+  w->distance = resize_array(w->distance, 0, num_nodes, sizeof(f64));
+  w->sigma = resize_array(w->sigma, w->capacity, num_nodes, sizeof(f64));
+  w->delta = resize_array(w->delta, w->capacity, num_nodes, sizeof(f64));
+  w->order = resize_array(w->order, w->capacity, num_nodes, sizeof(i64));
+  w->centrality =
+      resize_array(w->centrality, w->capacity, num_nodes, sizeof(f64));
+  w->capacity = num_nodes;
+
+  for (i64 i = 0; i < num_nodes; ++i)
+    w->distance[i] = INFINITY;
+}
+
+// Dijkstra from the source counting the shortest paths to every node,
+// then the dependencies of the source on each node, from the farthest
+// node back. A neighbor v precedes w if d(v) + cost = d(w). Zero-cost
+// edges would make two nodes precede each other, so they are skipped.
+void betweenness_source(Graph_View *view, Betweenness_Worker *w, i64 src) {
+  i64 num_order = 0;
+
+  w->distance[src] = 0;
+  w->sigma[src] = 1;
+  heap_push(&w->heap, src, 0);
+
+  while (w->heap.size > 0) {
+    f64 dist;
+    i64 v = heap_pop(&w->heap, &dist);
+
+    w->order[num_order++] = v;
+    w->delta[v] = 0;
+
+    for (i64 k = view->offsets[v]; k < view->offsets[v + 1]; ++k) {
+      i64 next = view->neighbors[k];
+      f64 cost = view->edge_cost[view->edge_ids[k]];
+      f64 next_dist = dist + cost;
+
+      if (cost <= 0)
+        continue;
+
+      if (next_dist < w->distance[next]) {
+        w->distance[next] = next_dist;
+        w->sigma[next] = w->sigma[v];
+        heap_push(&w->heap, next, next_dist);
+      } else if (next_dist == w->distance[next]) {
+        w->sigma[next] += w->sigma[v];
+      }
+    }
+  }
+
+  for (i64 i = num_order - 1; i > 0; --i) {
+    i64 node = w->order[i];
+    f64 share = (1 + w->delta[node]) / w->sigma[node];
+
+    for (i64 k = view->offsets[node]; k < view->offsets[node + 1]; ++k) {
+      i64 prev = view->neighbors[k];
+      f64 cost = view->edge_cost[view->edge_ids[k]];
+
+      if (cost > 0 && w->distance[prev] + cost == w->distance[node])
+        w->delta[prev] += w->sigma[prev] * share;
+    }
+
+    w->centrality[node] += w->delta[node];
+  }
+
+  for (i64 i = 0; i < num_order; ++i)
+    w->distance[w->order[i]] = INFINITY;
+}
+
+void betweenness_task(void *data, i64 worker, i64 begin, i64 end) {
+  Betweenness *bc = data;
+
+  for (i64 s = begin; s < end; ++s)
+    betweenness_source(&bc->view, &bc->workers[worker],
+                       bc->sources.items[s]);
+}
+
+// Sum the workers for each node.
+void betweenness_merge_task(void *data, i64 worker, i64 begin, i64 end) {
+  Betweenness *bc = data;
+
+  for (i64 i = begin; i < end; ++i) {
+    f64 sum = 0;
+    for (i64 k = 0; k < bc->num_workers; ++k)
+      sum += bc->workers[k].centrality[i];
+
+    bc->centrality[i] = sum * bc->scale;
+  }
+}
+
+// One source per task on the pool. With num_samples > 0 and fewer than
+// the live nodes, only that many sources are run, drawn with a fixed
+// seed so repeated runs agree. Sums are halved since every path of an
+// undirected graph is found from both of its ends.
+void build_betweenness(Graph *graph, Betweenness *bc, Worker_Pool *pool,
+                       i64 num_samples) {
+  i64 n = graph->num_nodes;
+  bc->view = get_graph_view(graph);
+
+  if (bc->capacity < n) {
+    bc->centrality = resize_array(bc->centrality, bc->capacity, n, sizeof(f64));
+    bc->capacity = n;
+  }
+
+  bc->sources.size = 0;
+  for (i64 i = 0; i < n; ++i)
+    if (bit_get(graph->node_enabled, i))
+      index_list_push(&bc->sources, i);
+
+  i64 num_live = bc->sources.size;
+  bc->sampled = num_samples > 0 && num_samples < num_live;
+
+  if (bc->sampled) {
+    // Partial Fisher-Yates shuffle, xorshift64 for the draws
+    u64 state = bc->seed;
+    i64 *items = bc->sources.items;
+
+    for (i64 i = 0; i < num_samples; ++i) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+
+      i64 j = i + (i64)(state % (u64)(num_live - i));
+      i64 t = items[i];
+      items[i] = items[j];
+      items[j] = t;
+    }
+
+    bc->sources.size = num_samples;
+  }
+
+  bc->scale = bc->sources.size > 0 ? .5 * num_live / bc->sources.size : 0;
+
+  if (pool->num_workers == 0)
+    pool_start(pool, 0);
+  bc->num_workers = pool->num_workers;
+
+  for (i64 k = 0; k < bc->num_workers; ++k) {
+    Betweenness_Worker *w = &bc->workers[k];
+    betweenness_worker_reserve(w, n);
+
+    for (i64 i = 0; i < n; ++i)
+      w->centrality[i] = 0;
+  }
+
+  pool_run(pool, bc->sources.size, 1, betweenness_task, bc);
+  pool_run(pool, n, BETWEENNESS_CHUNK, betweenness_merge_task, bc);
+
+  bc->max_centrality = 0;
+  for (i64 i = 0; i < n; ++i)
+    if (bc->centrality[i] > bc->max_centrality)
+      bc->max_centrality = bc->centrality[i];
+
+  bc->topology_version = graph->topology_version;
+  bc->geometry_version = graph->geometry_version;
+}
+
+b8 betweenness_is_current(Graph *graph, Betweenness *bc) {
+  return bc->topology_version == graph->topology_version &&
+         bc->geometry_version == graph->geometry_version;
+}
+
+// Exact up to BETWEENNESS_EXACT_LIMIT live nodes, sampled past that.
+void update_betweenness(Graph *graph, Betweenness *bc, Worker_Pool *pool) {
+  if (betweenness_is_current(graph, bc))
+    return;
+
+  b8 sample = graph->nodes_alive > BETWEENNESS_EXACT_LIMIT;
+  build_betweenness(graph, bc, pool, sample ? BETWEENNESS_SAMPLES : 0);
+
+  printf("Betweenness: %lld sources%s, max %g\n", bc->sources.size,
+         bc->sampled ? " sampled" : "", bc->max_centrality);
+}
+
+/*************/
+/* PAGE RANK */
+/*************/
+
+enum {
+  PAGE_RANK_CHUNK = 2048,
+};
+
+// PageRank as repeated sparse matrix-vector products. The live nodes are
+// packed into rows of a compact CSR matrix whose columns are i32 row
+// numbers, so the product reads half the index bytes of the adjacency.
+// Each step every row pulls the rank of its neighbors divided by their
+// degree. Rank of nodes without edges is spread over all rows.
+typedef struct {
+  u64 topology_version;
+
+  f64 damping;
+  f64 tolerance;
+  i64 max_iterations;
+  b8 use_avx2;
+
+  i64 rows_capacity;
+  i64 num_rows;
+  i64 *row_node;
+  i64 *row_offsets;
+  f64 *inv_degree;
+  f64 *rank;
+  f64 *next;
+  f64 *contrib;
+
+  i64 cols_capacity;
+  i32 *cols;
+
+  // Rank of every node slot once converged, 0 for free slots
+  i64 nodes_capacity;
+  i64 *node_row;
+  f64 *node_rank;
+  f64 max_rank;
+
+  // Topology version the ranks were computed at, the matrix may be newer
+  u64 ranks_topology_version;
+  i64 num_iterations;
+  f64 residual;
+
+  // The step being run, and sums of the workers
+  f64 base;
+  f64 worker_sum[MAX_WORKERS];
+  i64 gather_capacity[MAX_WORKERS];
+  f64 *gather[MAX_WORKERS];
+} Page_Rank;
+
+Page_Rank page_rank = {
+    .damping = .85,
+    .tolerance = 1e-9,
+    .max_iterations = 100,
+    .use_avx2 = 1,
+};
+
+void build_rank_matrix(Graph *graph, Page_Rank *pr) {
+  Adjacency *adj = get_adjacency(graph);
+  i64 n = graph->num_nodes;
+
+  if (pr->nodes_capacity < n) {
+    pr->node_row = resize_array(pr->node_row, pr->nodes_capacity, n,
+                                sizeof(i64));
+    pr->node_rank = resize_array(pr->node_rank, pr->nodes_capacity, n,
+                                 sizeof(f64));
+    pr->nodes_capacity = n;
+  }
+
+  // Row offsets hold one more entry than there are rows, even for none
+  if (pr->row_offsets == NULL || pr->rows_capacity < graph->nodes_alive) {
+    i64 old = pr->rows_capacity;
+    i64 cap = graph->nodes_alive;
+
+    pr->row_node = resize_array(pr->row_node, old, cap, sizeof(i64));
+    pr->row_offsets = resize_array(pr->row_offsets, 0, cap + 1, sizeof(i64));
+    pr->inv_degree = resize_array(pr->inv_degree, old, cap, sizeof(f64));
+    pr->rank = resize_array(pr->rank, old, cap, sizeof(f64));
+    pr->next = resize_array(pr->next, old, cap, sizeof(f64));
+    pr->contrib = resize_array(pr->contrib, old, cap, sizeof(f64));
+    pr->rows_capacity = cap;
+  }
+
+  if (pr->cols_capacity < adj->offsets[n]) {
+    pr->cols = resize_array(pr->cols, 0, adj->offsets[n], sizeof(i32));
+    pr->cols_capacity = adj->offsets[n];
+  }
+
+  pr->num_rows = 0;
+  for (i64 i = 0; i < n; ++i) {
+    pr->node_row[i] = -1;
+    if (bit_get(graph->node_enabled, i))
+      pr->node_row[i] = pr->num_rows++;
+  }
+
+  assert(pr->num_rows <= 0x7fffffff);
+
+  i64 num_cols = 0;
+  pr->row_offsets[0] = 0;
+
+  for (i64 i = 0; i < n; ++i) {
+    i64 r = pr->node_row[i];
+    if (r < 0)
+      continue;
+
+    i64 degree = adj->offsets[i + 1] - adj->offsets[i];
+
+    pr->row_node[r] = i;
+    pr->inv_degree[r] = degree > 0 ? 1. / degree : 0;
+
+    for (i64 k = adj->offsets[i]; k < adj->offsets[i + 1]; ++k)
+      pr->cols[num_cols++] = (i32)pr->node_row[adj->neighbors[k]];
+
+    pr->row_offsets[r + 1] = num_cols;
+  }
+
+  pr->topology_version = graph->topology_version;
+}
+
+// Share of every row to each neighbor, summing the rank of rows without
+// any.
+void page_rank_contrib_task(void *data, i64 worker, i64 begin, i64 end) {
+  Page_Rank *pr = data;
+  f64 dangling = 0;
+
+  for (i64 r = begin; r < end; ++r) {
+    pr->contrib[r] = pr->rank[r] * pr->inv_degree[r];
+    if (pr->inv_degree[r] == 0)
+      dangling += pr->rank[r];
+  }
+
+  pr->worker_sum[worker] += dangling;
+}
+
+void rank_rows_scalar(Page_Rank *pr, i64 worker, i64 begin, i64 end) {
+  for (i64 r = begin; r < end; ++r) {
+    f64 sum = 0;
+    for (i64 k = pr->row_offsets[r]; k < pr->row_offsets[r + 1]; ++k)
+      sum += pr->contrib[pr->cols[k]];
+
+    pr->next[r] = sum;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Gather the neighbor shares of all rows in the range four at a time,
+// then sum each row from the gathered run. Rows are short, so gathering
+// row by row would leave most lanes empty.
+__attribute__((target("avx2"))) void
+rank_rows_avx2(Page_Rank *pr, i64 worker, i64 begin, i64 end) {
+  i64 k0 = pr->row_offsets[begin];
+  i64 k1 = pr->row_offsets[end];
+
+  if (pr->gather_capacity[worker] < k1 - k0) {
+    pr->gather[worker] = resize_array(pr->gather[worker], 0, k1 - k0,
+                                      sizeof(f64));
+    pr->gather_capacity[worker] = k1 - k0;
+  }
+
+  // Entry k of the matrix is gathered to values[k - k0]
+  f64 *values = pr->gather[worker];
+  i64 k = k0;
+
+  for (; k + 4 <= k1; k += 4) {
+    __m128i idx = _mm_loadu_si128((__m128i *)&pr->cols[k]);
+    _mm256_storeu_pd(&values[k - k0],
+                     _mm256_i32gather_pd(pr->contrib, idx, 8));
+  }
+  for (; k < k1; ++k)
+    values[k - k0] = pr->contrib[pr->cols[k]];
+
+  for (i64 r = begin; r < end; ++r) {
+    f64 sum = 0;
+    for (k = pr->row_offsets[r]; k < pr->row_offsets[r + 1]; ++k)
+      sum += values[k - k0];
+
+    pr->next[r] = sum;
+  }
+}
+
+b8 cpu_has_avx2(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}
+#else
+void rank_rows_avx2(Page_Rank *pr, i64 worker, i64 begin, i64 end) {
+  rank_rows_scalar(pr, worker, begin, end);
+}
+
+b8 cpu_has_avx2(void) { return 0; }
+#endif
+
+// The product for the rows, then the damped step and its change.
+void page_rank_step_task(void *data, i64 worker, i64 begin, i64 end) {
+  Page_Rank *pr = data;
+  f64 change = 0;
+
+  if (pr->use_avx2)
+    rank_rows_avx2(pr, worker, begin, end);
+  else
+    rank_rows_scalar(pr, worker, begin, end);
+
+  for (i64 r = begin; r < end; ++r) {
+    pr->next[r] = pr->base + pr->damping * pr->next[r];
+    change += fabs(pr->next[r] - pr->rank[r]);
+  }
+
+  pr->worker_sum[worker] += change;
+}
+
+f64 page_rank_sum_workers(Page_Rank *pr) {
+  f64 sum = 0;
+
+  for (i64 k = 0; k < MAX_WORKERS; ++k) {
+    sum += pr->worker_sum[k];
+    pr->worker_sum[k] = 0;
+  }
+
+  return sum;
+}
+
+// One power iteration over the matrix, returns the L1 change.
+f64 page_rank_step(Page_Rank *pr, Worker_Pool *pool) {
+  i64 n = pr->num_rows;
+
+  page_rank_sum_workers(pr);
+  pool_run(pool, n, PAGE_RANK_CHUNK, page_rank_contrib_task, pr);
+
+  f64 dangling = page_rank_sum_workers(pr);
+  pr->base = (1 - pr->damping + pr->damping * dangling) / n;
+
+  pool_run(pool, n, PAGE_RANK_CHUNK, page_rank_step_task, pr);
+
+  f64 *t = pr->rank;
+  pr->rank = pr->next;
+  pr->next = t;
+
+  return page_rank_sum_workers(pr);
+}
+
+// Iterate from the uniform vector until the L1 change falls below the
+// tolerance or max_iterations is reached. AVX2 is used only if the CPU
+// has it.
+void find_page_rank(Graph *graph, Page_Rank *pr, Worker_Pool *pool) {
+  if (pr->topology_version != graph->topology_version)
+    build_rank_matrix(graph, pr);
+
+  i64 n = pr->num_rows;
+  pr->use_avx2 = pr->use_avx2 && cpu_has_avx2();
+
+  for (i64 r = 0; r < n; ++r)
+    pr->rank[r] = 1. / n;
+
+  pr->num_iterations = 0;
+  pr->residual = n > 0 ? INFINITY : 0;
+
+  while (pr->residual > pr->tolerance &&
+         pr->num_iterations < pr->max_iterations) {
+    pr->residual = page_rank_step(pr, pool);
+    pr->num_iterations++;
+  }
+
+  pr->max_rank = 0;
+  for (i64 i = 0; i < graph->num_nodes; ++i) {
+    i64 r = pr->node_row[i];
+    pr->node_rank[i] = r >= 0 ? pr->rank[r] : 0;
+
+    if (pr->node_rank[i] > pr->max_rank)
+      pr->max_rank = pr->node_rank[i];
+  }
+
+  pr->ranks_topology_version = graph->topology_version;
+}
+
+// Ranks depend on the edges only, moving nodes keeps them.
+b8 page_rank_is_current(Graph *graph, Page_Rank *pr) {
+  return pr->ranks_topology_version == graph->topology_version;
+}
+
+/*********************/
+/* STRONG COMPONENTS */
+/*********************/
+
+// Strongly connected components of the directed graph, by Kosaraju's
+// algorithm. A depth-first search over the out-edges lists the nodes by
+// finish time, then a search over the in-edges from every node not yet
+// labeled, latest finished first, labels one component. Both searches
+// keep an explicit stack, so a long chain cannot overflow the call stack.
+typedef struct {
+  u64 topology_version;
+
+  i64 capacity;
+  i64 num_components;
+  i64 num_nontrivial;
+  i64 largest;
+
+  // Component of every node slot, -1 for free slots, and the size of
+  // every component
+  i64 *component;
+  i64 *size;
+
+  // Live nodes by finish time, and the search stack of nodes with the
+  // next out-edge entry of each
+  i64 num_order;
+  i64 *order;
+  i64 *stack_node;
+  i64 *stack_next;
+  u64 *visited;
+} Strong_Components;
+
+Strong_Components strong_components = {0};
+
+void strong_components_reserve(Strong_Components *scc, i64 num_nodes) {
+  if (num_nodes <= scc->capacity)
+    return;
+
+  i64 n = num_nodes;
+  i64 c = scc->capacity;
+
+  scc->component = resize_array(scc->component, c, n, sizeof(i64));
+  scc->size = resize_array(scc->size, c, n, sizeof(i64));
+  scc->order = resize_array(scc->order, c, n, sizeof(i64));
+  scc->stack_node = resize_array(scc->stack_node, c, n, sizeof(i64));
+  scc->stack_next = resize_array(scc->stack_next, c, n, sizeof(i64));
+  scc->visited =
+      resize_array(scc->visited, (c + 63) / 64, (n + 63) / 64, sizeof(u64));
+  scc->capacity = n;
+}
+
+// Append the nodes reachable from root over the out-edges to the order,
+// each once all of its successors are in.
+void strong_components_finish_order(Strong_Components *scc, Adjacency *out,
+                                    i64 root) {
+  i64 depth = 0;
+
+  bit_set(scc->visited, root, 1);
+  scc->stack_node[depth] = root;
+  scc->stack_next[depth] = out->offsets[root];
+  depth++;
+
+  while (depth > 0) {
+    i64 node_idx = scc->stack_node[depth - 1];
+    i64 k = scc->stack_next[depth - 1];
+
+    if (k == out->offsets[node_idx + 1]) {
+      scc->order[scc->num_order++] = node_idx;
+      depth--;
+      continue;
+    }
+
+    scc->stack_next[depth - 1] = k + 1;
+
+    i64 next_idx = out->neighbors[k];
+    if (bit_get(scc->visited, next_idx))
+      continue;
+
+    bit_set(scc->visited, next_idx, 1);
+    scc->stack_node[depth] = next_idx;
+    scc->stack_next[depth] = out->offsets[next_idx];
+    depth++;
+  }
+}
+
+// Label every unlabeled node that reaches root over the in-edges.
+i64 strong_components_collect(Strong_Components *scc, Adjacency *in,
+                              i64 root, i64 label) {
+  i64 depth = 0;
+  i64 count = 0;
+
+  scc->component[root] = label;
+  scc->stack_node[depth++] = root;
+
+  while (depth > 0) {
+    i64 node_idx = scc->stack_node[--depth];
+    count++;
+
+    for (i64 k = in->offsets[node_idx]; k < in->offsets[node_idx + 1]; ++k) {
+      i64 prev_idx = in->neighbors[k];
+
+      if (scc->component[prev_idx] < 0) {
+        scc->component[prev_idx] = label;
+        scc->stack_node[depth++] = prev_idx;
+      }
+    }
+  }
+
+  return count;
+}
+
+void find_strong_components(Graph *graph, Strong_Components *scc) {
+  Adjacency *out = get_out_adjacency(graph);
+  Adjacency *in = get_in_adjacency(graph);
+  i64 n = graph->num_nodes;
+
+  strong_components_reserve(scc, n);
+
+  for (i64 i = 0; i < (n + 63) / 64; ++i)
+    scc->visited[i] = 0;
+  for (i64 i = 0; i < n; ++i)
+    scc->component[i] = -1;
+
+  scc->num_order = 0;
+  for (i64 i = 0; i < n; ++i)
+    if (bit_get(graph->node_enabled, i) && !bit_get(scc->visited, i))
+      strong_components_finish_order(scc, out, i);
+
+  scc->num_components = 0;
+  scc->num_nontrivial = 0;
+  scc->largest = 0;
+
+  for (i64 j = scc->num_order - 1; j >= 0; --j) {
+    i64 root = scc->order[j];
+    if (scc->component[root] >= 0)
+      continue;
+
+    i64 label = scc->num_components++;
+    i64 size = strong_components_collect(scc, in, root, label);
+
+    scc->size[label] = size;
+    if (size > 1)
+      scc->num_nontrivial++;
+    if (size > scc->largest)
+      scc->largest = size;
+  }
+
+  scc->topology_version = graph->topology_version;
+}
+
+b8 strong_components_are_current(Graph *graph, Strong_Components *scc) {
+  return scc->topology_version == graph->topology_version;
+}
+
+/****************/
+/* MAXIMUM FLOW */
+/****************/
+
+enum {
+  // Heights are recomputed once the relabel work since the last time
+  // passes this many units per node plus one per arc
+  MAX_FLOW_GLOBAL_RELABEL_FACTOR = 6,
+};
+
+// Maximum flow between two nodes by push-relabel, with the edge weights
+// as capacities. Every adjacency entry is an arc with its own residual
+// capacity, paired with the entry of the same edge at the other end. An
+// undirected edge gives both arcs its weight, a directed one only the
+// arc from src to dst.
+//
+// Only the first phase runs: excess is pushed towards dst until no node
+// that can still reach dst holds any. That gives the flow value and the
+// minimum cut, but not the flow of every edge. Active nodes are taken in
+// FIFO order. A global relabel sets every height to the residual
+// distance to dst, and lifts nodes that cannot reach dst to num_nodes,
+// where they are left alone. A height no node has anymore, a gap, cuts
+// off every node above it the same way.
+typedef struct {
+  u64 topology_version;
+  u64 geometry_version;
+  b8 directed;
+  i64 src;
+  i64 dst;
+
+  i64 nodes_capacity;
+  i64 entries_capacity;
+  i64 edges_capacity;
+  f64 *residual;
+  i64 *reverse;
+  i64 *edge_entry;
+  f64 *excess;
+  i64 *height;
+  i64 *current;
+  i64 *count;
+  u64 *queued;
+
+  // Ring of active nodes, each in it at most once
+  i64 *queue;
+  i64 queue_head;
+  i64 queue_size;
+  i64 work;
+
+  f64 flow;
+  Index_List cut;
+
+  i64 num_pushes;
+  i64 num_relabels;
+  i64 num_global_relabels;
+  i64 num_gaps;
+} Max_Flow;
+
+Max_Flow max_flow = {.src = -1, .dst = -1};
+
+void max_flow_reserve(Graph *graph, Max_Flow *mf) {
+  i64 n = graph->num_nodes;
+  i64 m = graph->num_edges;
+  i64 c = mf->nodes_capacity;
+
+  if (n > c) {
+    mf->excess = resize_array(mf->excess, c, n, sizeof(f64));
+    mf->height = resize_array(mf->height, c, n, sizeof(i64));
+    mf->current = resize_array(mf->current, c, n, sizeof(i64));
+    mf->count = resize_array(mf->count, c + 1, n + 1, sizeof(i64));
+    mf->queue = resize_array(mf->queue, c, n, sizeof(i64));
+    mf->queued =
+        resize_array(mf->queued, (c + 63) / 64, (n + 63) / 64, sizeof(u64));
+    mf->nodes_capacity = n;
+  }
+
+  if (m > mf->edges_capacity) {
+    mf->edge_entry = resize_array(mf->edge_entry, 0, m, sizeof(i64));
+    mf->edges_capacity = m;
+  }
+
+  if (m * 2 > mf->entries_capacity) {
+    mf->residual = resize_array(mf->residual, 0, m * 2, sizeof(f64));
+    mf->reverse = resize_array(mf->reverse, 0, m * 2, sizeof(i64));
+    mf->entries_capacity = m * 2;
+  }
+}
+
+void max_flow_enqueue(Max_Flow *mf, i64 n, i64 node_idx) {
+  if (bit_get(mf->queued, node_idx))
+    return;
+
+  bit_set(mf->queued, node_idx, 1);
+  mf->queue[(mf->queue_head + mf->queue_size) % n] = node_idx;
+  mf->queue_size++;
+}
+
+// Heights from a breadth-first search back from dst over the arcs with
+// residual capacity, then the queue of active nodes anew.
+void max_flow_global_relabel(Graph *graph, Max_Flow *mf, Adjacency *adj) {
+  i64 n = graph->num_nodes;
+
+  for (i64 i = 0; i < n; ++i)
+    mf->height[i] = n;
+  for (i64 h = 0; h <= n; ++h)
+    mf->count[h] = 0;
+
+  i64 head = 0;
+  i64 tail = 0;
+  mf->height[mf->dst] = 0;
+  mf->queue[tail++] = mf->dst;
+
+  while (head < tail) {
+    i64 node_idx = mf->queue[head++];
+
+    for (i64 k = adj->offsets[node_idx]; k < adj->offsets[node_idx + 1];
+         ++k) {
+      i64 prev_idx = adj->neighbors[k];
+
+      if (mf->height[prev_idx] == n && prev_idx != mf->src &&
+          mf->residual[mf->reverse[k]] > 0) {
+        mf->height[prev_idx] = mf->height[node_idx] + 1;
+        mf->queue[tail++] = prev_idx;
+      }
+    }
+  }
+
+  for (i64 k = 0; k < tail; ++k) {
+    i64 node_idx = mf->queue[k];
+    mf->count[mf->height[node_idx]]++;
+    mf->current[node_idx] = adj->offsets[node_idx];
+  }
+
+  for (i64 i = 0; i < (n + 63) / 64; ++i)
+    mf->queued[i] = 0;
+  mf->queue_head = 0;
+  mf->queue_size = 0;
+
+  // The queue is refilled from its own front, never past the entry read
+  for (i64 k = 0; k < tail; ++k) {
+    i64 node_idx = mf->queue[k];
+    if (node_idx != mf->dst && mf->excess[node_idx] > 0)
+      max_flow_enqueue(mf, n, node_idx);
+  }
+
+  mf->work = 0;
+  mf->num_global_relabels++;
+}
+
+// Lift the node just above its lowest residual neighbor. If that empties
+// its old height, everything above the gap is cut off from dst.
+void max_flow_relabel(Graph *graph, Max_Flow *mf, Adjacency *adj,
+                      i64 node_idx) {
+  i64 n = graph->num_nodes;
+  i64 old = mf->height[node_idx];
+  i64 height = n;
+
+  for (i64 k = adj->offsets[node_idx]; k < adj->offsets[node_idx + 1]; ++k)
+    if (mf->residual[k] > 0 && mf->height[adj->neighbors[k]] + 1 < height)
+      height = mf->height[adj->neighbors[k]] + 1;
+
+  mf->work += adj->offsets[node_idx + 1] - adj->offsets[node_idx] + 12;
+  mf->num_relabels++;
+
+  if (--mf->count[old] == 0) {
+    for (i64 i = 0; i < n; ++i)
+      if (mf->height[i] > old && mf->height[i] < n) {
+        mf->count[mf->height[i]]--;
+        mf->height[i] = n;
+      }
+
+    height = n;
+    mf->num_gaps++;
+  }
+
+  mf->height[node_idx] = height;
+  if (height < n)
+    mf->count[height]++;
+  mf->current[node_idx] = adj->offsets[node_idx];
+}
+
+// Push the excess of the node down admissible arcs, relabeling whenever
+// it runs out of them, until it is empty or cut off.
+void max_flow_discharge(Graph *graph, Max_Flow *mf, Adjacency *adj,
+                        i64 node_idx) {
+  i64 n = graph->num_nodes;
+
+  while (mf->excess[node_idx] > 0) {
+    i64 k = mf->current[node_idx];
+
+    if (k == adj->offsets[node_idx + 1]) {
+      max_flow_relabel(graph, mf, adj, node_idx);
+      if (mf->height[node_idx] >= n)
+        return;
+      continue;
+    }
+
+    i64 next_idx = adj->neighbors[k];
+
+    if (mf->residual[k] > 0 &&
+        mf->height[node_idx] == mf->height[next_idx] + 1) {
+      f64 amount = mf->excess[node_idx];
+      if (amount > mf->residual[k])
+        amount = mf->residual[k];
+
+      mf->residual[k] -= amount;
+      mf->residual[mf->reverse[k]] += amount;
+      mf->excess[node_idx] -= amount;
+      mf->excess[next_idx] += amount;
+      mf->num_pushes++;
+
+      if (next_idx != mf->dst)
+        max_flow_enqueue(mf, n, next_idx);
+    } else {
+      mf->current[node_idx] = k + 1;
+    }
+  }
+}
+
+// Arcs of the adjacency with the weights as residual capacities, each
+// paired with the arc of the same edge the other way.
+void max_flow_init_arcs(Graph *graph, Max_Flow *mf, Adjacency *adj) {
+  for (i64 e = 0; e < graph->num_edges; ++e)
+    mf->edge_entry[e] = -1;
+
+  for (i64 i = 0; i < graph->num_nodes; ++i)
+    for (i64 k = adj->offsets[i]; k < adj->offsets[i + 1]; ++k) {
+      i64 e = adj->edge_ids[k];
+
+      if (mf->edge_entry[e] < 0) {
+        mf->edge_entry[e] = k;
+      } else {
+        mf->reverse[k] = mf->edge_entry[e];
+        mf->reverse[mf->edge_entry[e]] = k;
+      }
+
+      b8 backward = graph->directed && graph->edge_src[e] != i;
+      mf->residual[k] = backward ? 0 : get_edge_weight(graph, e);
+    }
+}
+
+void find_max_flow(Graph *graph, Max_Flow *mf, i64 src, i64 dst) {
+  Adjacency *adj = get_adjacency(graph);
+  i64 n = graph->num_nodes;
+
+  max_flow_reserve(graph, mf);
+
+  mf->topology_version = graph->topology_version;
+  mf->geometry_version = graph->geometry_version;
+  mf->directed = graph->directed;
+  mf->src = src;
+  mf->dst = dst;
+  mf->flow = 0;
+  mf->cut.size = 0;
+  mf->num_pushes = 0;
+  mf->num_relabels = 0;
+  mf->num_global_relabels = 0;
+  mf->num_gaps = 0;
+
+  if (!validate_node(graph, src) || !validate_node(graph, dst) ||
+      src == dst || !nodes_connected(graph, src, dst))
+    return;
+
+  max_flow_init_arcs(graph, mf, adj);
+
+  for (i64 i = 0; i < n; ++i)
+    mf->excess[i] = 0;
+
+  // Saturate every arc out of src to start the preflow
+  for (i64 k = adj->offsets[src]; k < adj->offsets[src + 1]; ++k) {
+    f64 amount = mf->residual[k];
+
+    mf->residual[k] = 0;
+    mf->residual[mf->reverse[k]] += amount;
+    mf->excess[adj->neighbors[k]] += amount;
+    mf->excess[src] -= amount;
+  }
+
+  max_flow_global_relabel(graph, mf, adj);
+
+  i64 work_limit = MAX_FLOW_GLOBAL_RELABEL_FACTOR * n + adj->offsets[n];
+
+  while (mf->queue_size > 0) {
+    i64 node_idx = mf->queue[mf->queue_head];
+    mf->queue_head = (mf->queue_head + 1) % n;
+    mf->queue_size--;
+    bit_set(mf->queued, node_idx, 0);
+
+    if (mf->height[node_idx] < n)
+      max_flow_discharge(graph, mf, adj, node_idx);
+
+    if (mf->work > work_limit)
+      max_flow_global_relabel(graph, mf, adj);
+  }
+
+  mf->flow = mf->excess[dst];
+
+  // Nodes that can no longer reach dst form the src side of the cut
+  max_flow_global_relabel(graph, mf, adj);
+
+  for (i64 e = 0; e < graph->num_edges; ++e) {
+    if (!adjacency_includes(graph, e))
+      continue;
+
+    b8 src_side = mf->height[graph->edge_src[e]] >= n;
+    b8 dst_side = mf->height[graph->edge_dst[e]] >= n;
+
+    if (graph->directed ? src_side && !dst_side : src_side != dst_side)
+      index_list_push(&mf->cut, e);
+  }
+}
+
+b8 max_flow_is_current(Graph *graph, Max_Flow *mf, i64 src, i64 dst) {
+  return mf->src == src && mf->dst == dst &&
+         mf->directed == graph->directed &&
+         mf->topology_version == graph->topology_version &&
+         mf->geometry_version == graph->geometry_version;
+}
+
+// Show the minimum cut in place of the path, like the spanning forest.
+void highlight_max_flow(Graph *graph, Max_Flow *mf, i64 src, i64 dst) {
+  clear_node_edge_highlight(graph);
+  clear_paths(graph);
+  graph->path_topology_version = 0;
+
+  if (!validate_node(graph, src) || !validate_node(graph, dst)) {
+    printf("Invalid source or destination node index.\n");
+    return;
+  }
+
+  bit_set(graph->node_highlight, src, 1);
+  bit_set(graph->node_highlight, dst, 1);
+
+  if (!max_flow_is_current(graph, mf, src, dst))
+    find_max_flow(graph, mf, src, dst);
+
+  for (i64 k = 0; k < mf->cut.size; ++k)
+    bit_set(graph->edge_highlight, mf->cut.items[k], 1);
+
+  printf("Maximum flow %g, %lld edges in the minimum cut, %lld pushes, "
+         "%lld relabels, %lld global relabels, %lld gaps\n",
+         mf->flow, mf->cut.size, mf->num_pushes, mf->num_relabels,
+         mf->num_global_relabels, mf->num_gaps);
 }
 
 #endif
@@ -0,0 +1,364 @@
+#if 0 /*
+#/  ================================================================
+#/
+#/    bench.c
+#/
+#/  Benchmarks of the graph algorithms on generated graphs.
+#/
+#/    ./bench.c [side] [delta ...]
+#/
+#/  The graph is a jittered grid of side by side nodes with random
+#/  extra edges. Deltas default to a sweep around the mean edge
+#/  length. Spanning forests are timed with Kruskal and Borůvka,
+#/  PageRank steps with the CSR kernels and a plain loop over the edges,
+#/  and maximum flows between random pairs of nodes. Last, a smaller
+#/  graph is saved with its contraction hierarchy and loaded back,
+#/  checking that the saved hierarchy is reused.
+#/
+#/  ================================================================
+#/
+#/    Self-compilation shell script
+#/
+SRC=${0##*./}
+BIN=${SRC%.*}
+gcc                                         \
+  -Wall -Wextra -pedantic                   \
+  -Wno-old-style-declaration                \
+  -Wno-missing-braces                       \
+  -Wno-unused-variable                      \
+  -Wno-unused-but-set-variable              \
+  -Wno-unused-parameter                     \
+  -Wno-overlength-strings                   \
+  -O3                                       \
+  -o $BIN $SRC                              \
+  -lX11 -lm -lpthread &&                    \
+  ./$BIN $@ && rm $BIN
+exit $? # */
+#endif
+
+#include "algorithms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+f64 bench_time(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Jittered grid with edges to the right and down neighbors, most of them
+// kept, plus a few longer random edges.
+void generate_graph(i64 side) {
+  srand(1);
+  reserve_nodes(&graph, side * side);
+  reserve_edges(&graph, side * side * 2);
+
+  for (i64 i = 0; i < side * side; ++i)
+    add_node((i % side) * 150 + rand() % 40, (i / side) * 150 + rand() % 40);
+
+  for (i64 i = 0; i < side * side; ++i) {
+    if (i % side + 1 < side && rand() % 4 != 0)
+      add_edge(i, i + 1);
+    if (i + side < side * side && rand() % 4 != 0)
+      add_edge(i, i + side);
+    if (rand() % 16 == 0)
+      add_edge(i, rand() % (side * side));
+  }
+}
+
+void bench_delta_stepping(f64 *deltas, i64 num_deltas) {
+  i64 src = 0;
+
+  // Warm up the adjacency and the scratch arrays
+  build_path_tree(&graph, &path_tree, src);
+  find_shortest_paths_delta(&graph, &delta_stepping, &worker_pool, src, 0);
+
+  f64 t0 = bench_time();
+  build_path_tree(&graph, &path_tree, src);
+  f64 t_sequential = bench_time() - t0;
+
+  printf("Single-source shortest paths, %lld nodes, %lld edges, %lld "
+         "workers\n",
+         graph.nodes_alive, graph.edges_alive, worker_pool.num_workers);
+  printf("  %-24s %10.3f ms\n", "Dijkstra", t_sequential * 1000);
+
+  for (i64 i = 0; i < num_deltas; ++i) {
+    t0 = bench_time();
+    find_shortest_paths_delta(&graph, &delta_stepping, &worker_pool, src,
+                              deltas[i]);
+    f64 t = bench_time() - t0;
+
+    i64 mismatches = 0;
+    for (i64 j = 0; j < graph.num_nodes; ++j)
+      if (delta_stepping.distance[j] != path_tree.distance[j])
+        mismatches++;
+
+    c8 name[64];
+    snprintf(name, sizeof name, "Delta-stepping %g", delta_stepping.delta);
+    printf("  %-24s %10.3f ms  %6lld rounds  %5.2fx%s\n", name, t * 1000,
+           delta_stepping.num_rounds, t_sequential / t,
+           mismatches > 0 ? "  MISMATCH" : "");
+  }
+
+  // A fresh state grows its buckets while it drains the first ones. With
+  // a delta above the edge lengths the bucket being drained keeps getting
+  // refilled meanwhile, and 128 buckets outgrow the initial 64.
+  f64 max_distance = 0;
+  for (i64 j = 0; j < graph.num_nodes; ++j)
+    if (path_tree.distance[j] < INFINITY &&
+        path_tree.distance[j] > max_distance)
+      max_distance = path_tree.distance[j];
+
+  Delta_Stepping fresh = {0};
+  f64 delta = max_distance / 128;
+
+  t0 = bench_time();
+  find_shortest_paths_delta(&graph, &fresh, &worker_pool, src, delta);
+  f64 t = bench_time() - t0;
+
+  i64 mismatches = 0;
+  for (i64 j = 0; j < graph.num_nodes; ++j)
+    if (fresh.distance[j] != path_tree.distance[j])
+      mismatches++;
+
+  c8 name[64];
+  snprintf(name, sizeof name, "Fresh, delta %g", fresh.delta);
+  printf("  %-24s %10.3f ms  %6lld rounds  %5.2fx%s\n", name, t * 1000,
+         fresh.num_rounds, t_sequential / t,
+         mismatches > 0 ? "  MISMATCH" : "");
+}
+
+void bench_spanning_forest(void) {
+  Spanning_Forest parallel = {0};
+
+  // Warm up the edge costs and the scratch arrays
+  kruskal_spanning_forest(&graph, &spanning_forest);
+  boruvka_spanning_forest(&graph, &parallel, &worker_pool);
+
+  f64 t0 = bench_time();
+  kruskal_spanning_forest(&graph, &spanning_forest);
+  f64 t_kruskal = bench_time() - t0;
+
+  t0 = bench_time();
+  boruvka_spanning_forest(&graph, &parallel, &worker_pool);
+  f64 t_boruvka = bench_time() - t0;
+
+  // Ties are broken the same way, so the edge sets must be equal
+  u8 *in_forest = resize_array(NULL, 0, graph.num_edges, sizeof(u8));
+  for (i64 k = 0; k < parallel.edges.size; ++k)
+    in_forest[parallel.edges.items[k]] = 1;
+
+  i64 mismatches = parallel.edges.size != spanning_forest.edges.size;
+  for (i64 k = 0; k < spanning_forest.edges.size; ++k)
+    if (!in_forest[spanning_forest.edges.items[k]])
+      mismatches++;
+
+  free(in_forest);
+
+  printf("Spanning forest, %lld edges in %lld trees, total cost %g\n",
+         spanning_forest.edges.size, spanning_forest.num_trees,
+         spanning_forest.total_cost);
+  printf("  %-24s %10.3f ms\n", "Kruskal", t_kruskal * 1000);
+  printf("  %-24s %10.3f ms  %6lld rounds  %5.2fx%s\n", "Boruvka",
+         t_boruvka * 1000, parallel.num_rounds, t_kruskal / t_boruvka,
+         mismatches > 0 ? "  MISMATCH" : "");
+}
+
+// One PageRank step straight over the edge arrays, for comparison with
+// the CSR kernels. degree is the live degree of every node slot.
+void naive_page_rank_step(f64 *rank, f64 *next, f64 *degree, f64 damping) {
+  f64 dangling = 0;
+  for (i64 i = 0; i < graph.num_nodes; ++i)
+    if (bit_get(graph.node_enabled, i) && degree[i] == 0)
+      dangling += rank[i];
+
+  f64 base = (1 - damping + damping * dangling) / graph.nodes_alive;
+  for (i64 i = 0; i < graph.num_nodes; ++i)
+    next[i] = bit_get(graph.node_enabled, i) ? base : 0;
+
+  for (i64 e = 0; e < graph.num_edges; ++e) {
+    if (!adjacency_includes(&graph, e))
+      continue;
+
+    i64 src = graph.edge_src[e];
+    i64 dst = graph.edge_dst[e];
+    next[dst] += damping * rank[src] / degree[src];
+    next[src] += damping * rank[dst] / degree[dst];
+  }
+}
+
+void bench_page_rank(i64 iterations) {
+  Adjacency *adj = get_adjacency(&graph);
+  i64 n = graph.num_nodes;
+  f64 *rank = resize_array(NULL, 0, n, sizeof(f64));
+  f64 *next = resize_array(NULL, 0, n, sizeof(f64));
+  f64 *degree = resize_array(NULL, 0, n, sizeof(f64));
+
+  for (i64 i = 0; i < n; ++i) {
+    degree[i] = adj->offsets[i + 1] - adj->offsets[i];
+    rank[i] = bit_get(graph.node_enabled, i) ? 1. / graph.nodes_alive : 0;
+  }
+
+  f64 t0 = bench_time();
+  for (i64 k = 0; k < iterations; ++k) {
+    naive_page_rank_step(rank, next, degree, page_rank.damping);
+    f64 *t = rank;
+    rank = next;
+    next = t;
+  }
+  f64 t_naive = bench_time() - t0;
+
+  // Fixed number of steps for every kernel
+  page_rank.tolerance = 0;
+  page_rank.max_iterations = iterations;
+  find_page_rank(&graph, &page_rank, &worker_pool);
+
+  i64 entries = page_rank.row_offsets[page_rank.num_rows];
+  printf("PageRank, %lld iterations over %lld matrix entries, %lld "
+         "workers\n",
+         iterations, entries, worker_pool.num_workers);
+  printf("  %-24s %10.3f ms  %8.1f M edges/s\n", "Edge loop", t_naive * 1000,
+         entries * iterations / t_naive * 1e-6);
+
+  for (i64 avx2 = 0; avx2 <= 1; ++avx2) {
+    page_rank.use_avx2 = avx2;
+    if (avx2 && !cpu_has_avx2())
+      break;
+
+    t0 = bench_time();
+    find_page_rank(&graph, &page_rank, &worker_pool);
+    f64 t = bench_time() - t0;
+
+    f64 diff = 0;
+    for (i64 i = 0; i < n; ++i)
+      diff += fabs(page_rank.node_rank[i] - rank[i]);
+
+    printf("  %-24s %10.3f ms  %8.1f M edges/s  %5.2fx%s\n",
+           avx2 ? "CSR AVX2" : "CSR scalar", t * 1000,
+           entries * iterations / t * 1e-6, t_naive / t,
+           diff > 1e-9 ? "  MISMATCH" : "");
+  }
+
+  free(rank);
+  free(next);
+  free(degree);
+}
+
+void bench_max_flow(i64 num_queries) {
+  srand(2);
+  printf("Maximum flow, %lld nodes, %lld edges\n", graph.nodes_alive,
+         graph.edges_alive);
+
+  for (i64 q = 0; q < num_queries; ++q) {
+    i64 src = rand() % graph.num_nodes;
+    i64 dst = rand() % graph.num_nodes;
+
+    f64 t0 = bench_time();
+    find_max_flow(&graph, &max_flow, src, dst);
+    f64 t = bench_time() - t0;
+
+    c8 name[64];
+    snprintf(name, sizeof name, "%lld to %lld", src, dst);
+    printf("  %-24s %10.3f ms  flow %g  %lld pushes  %lld relabels  %lld "
+           "gaps\n",
+           name, t * 1000, max_flow.flow, max_flow.num_pushes,
+           max_flow.num_relabels, max_flow.num_gaps);
+  }
+}
+
+// Save a graph with its hierarchy and load both back. The saved
+// hierarchy is only reused if the reloaded graph has the fingerprint it
+// was tagged with, so the graph first gets what the file cannot hold
+// exactly: fractional coordinates, a free slot and quantized weights.
+// The hierarchy takes long to build, so this replaces the graph with a
+// smaller one and runs last.
+void bench_contraction_roundtrip(i64 side, i64 num_queries) {
+  clear_graph(&graph);
+  generate_graph(side);
+  srand(3);
+
+  for (i64 i = 0; i < graph.num_nodes; i += 7)
+    move_node(i, graph.node_x[i] + .5, graph.node_y[i] + .25);
+  delete_node(graph.num_nodes / 2);
+
+  for (i64 i = 0; i < graph.num_edges; ++i)
+    if (bit_get(graph.edge_enabled, i))
+      set_edge_weight(&graph, i, 1 + rand() % 1000 * .1);
+  quantize_edge_weights(&graph, 1, 0);
+  set_weighted(&graph, 1);
+
+  f64 t0 = bench_time();
+  build_contraction_hierarchy(&graph, &contraction_hierarchy);
+  f64 t_build = bench_time() - t0;
+
+  t0 = bench_time();
+  save_graph_and_hierarchy(&contraction_hierarchy, "bench-graph.txt",
+                           "bench-graph.ch");
+  f64 t_save = bench_time() - t0;
+
+  t0 = bench_time();
+  load_graph("bench-graph.txt");
+  b8 reused = load_contraction_hierarchy(&graph, &contraction_hierarchy,
+                                         "bench-graph.ch");
+  f64 t_load = bench_time() - t0;
+
+  remove("bench-graph.txt");
+  remove("bench-graph.ch");
+
+  printf("Contraction hierarchy round trip, %lld nodes, %lld edges\n",
+         graph.nodes_alive, graph.edges_alive);
+  printf("  %-24s %10.3f ms\n", "Build", t_build * 1000);
+  printf("  %-24s %10.3f ms\n", "Save", t_save * 1000);
+  printf("  %-24s %10.3f ms  %s\n", "Load", t_load * 1000,
+         reused ? "reused" : "NOT REUSED");
+  assert(reused);
+
+  // Answers from the loaded hierarchy against Dijkstra on the loaded graph
+  i64 mismatches = 0;
+
+  for (i64 q = 0; q < num_queries; ++q) {
+    i64 src = rand() % graph.num_nodes;
+    i64 dst = rand() % graph.num_nodes;
+
+    build_path_tree(&graph, &path_tree, src);
+    find_shortest_path_ch(&graph, &contraction_hierarchy, &ch_search,
+                          &ch_search_reverse, &path_search, src, dst);
+
+    f64 expected = path_tree.distance[dst];
+    f64 found = path_search.distance[dst];
+    if (expected == INFINITY ? found != -1
+                             : fabs(found - expected) > expected * 1e-9)
+      mismatches++;
+  }
+
+  printf("  %-24s %10lld queries%s\n", "Queries", num_queries,
+         mismatches > 0 ? "  MISMATCH" : "");
+}
+
+i32 main(i32 argc, c8 **argv) {
+  i64 side = argc > 1 ? atoll(argv[1]) : 300;
+
+  pool_start(&worker_pool, 0);
+  generate_graph(side);
+
+  // Mean edge length first, then the explicit deltas or a sweep
+  f64 deltas[64] = {0};
+  i64 num_deltas = 1;
+
+  for (i64 i = 2; i < argc && num_deltas < 64; ++i)
+    deltas[num_deltas++] = atof(argv[i]);
+
+  if (argc <= 2) {
+    f64 sweep[] = {25, 50, 100, 400, 1600, 6400};
+    for (i64 i = 0; i < (i64)(sizeof sweep / sizeof *sweep); ++i)
+      deltas[num_deltas++] = sweep[i];
+  }
+
+  bench_delta_stepping(deltas, num_deltas);
+  bench_spanning_forest();
+  bench_page_rank(20);
+  bench_max_flow(4);
+  bench_contraction_roundtrip(40, 64);
+  return 0;
+}
@@ -2,185 +2,1442 @@
 #define GRAPH_H
 
 #include "lib/graphics.c"
+#include "spatial.h"
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 enum {
-  MAX_NUM_NODES = 1024,
-  MAX_NUM_EDGES = 1024,
-  MAX_PATH_SIZE = 1024,
+  NODE_GRID_CELL_SIZE = 128,
+  MAX_QUANTIZED_WEIGHT = 65535,
 };
 
+/***********/
+/* STORAGE */
+/***********/
+
+// Reallocate an array from old_count to new_count elements, zeroing the
+// added tail.
+void *resize_array(void *data, i64 old_count, i64 new_count, i64 elem_size) {
+  data = realloc(data, new_count * elem_size);
+  assert(data != NULL || new_count == 0);
+
+  if (new_count > old_count)
+    memset((u8 *)data + old_count * elem_size, 0,
+           (new_count - old_count) * elem_size);
+
+  return data;
+}
+
+i64 bitset_words(i64 count) { return (count + 63) / 64; }
+
+b8 bit_get(u64 *bits, i64 i) { return (bits[i / 64] >> (i % 64)) & 1; }
+
+void bit_set(u64 *bits, i64 i, b8 value) {
+  if (value)
+    bits[i / 64] |= 1ull << (i % 64);
+  else
+    bits[i / 64] &= ~(1ull << (i % 64));
+}
+
+// Compressed sparse row index of the enabled edges. Neighbors of node i
+// are neighbors[offsets[i]] .. neighbors[offsets[i + 1] - 1], and
+// edge_ids holds the edge leading to each of them. Self-loops are left
+// out. The index is rebuilt on first use after the topology changes.
 typedef struct {
-  b8 enabled;
-  i64 src;
-  i64 dst;
-  f64 width;
-  b8 hover;
-  b8 highlight;
-} Edge;
+  u64 version;
+  i64 nodes_capacity;
+  i64 edges_capacity;
+  i64 *offsets;
+  i64 *neighbors;
+  i64 *edge_ids;
+} Adjacency;
 
+// Which edge endpoints list each other in an adjacency. The undirected
+// one lists every edge at both endpoints, the out one at its source and
+// the in one at its destination.
+enum {
+  ADJACENCY_BOTH = 0,
+  ADJACENCY_OUT = 1,
+  ADJACENCY_IN = 2,
+};
+
+// Union-find over node slots, with union by rank and path compression.
+// add_node and add_edge keep it current. A union cannot be undone, so
+// deletions only mark it invalid and it is rebuilt from the live edges
+// on the next query. Once flat, every parent is a root, and threads can
+// compare parents without writing.
 typedef struct {
-  b8 enabled;
-  f64 radius;
-  f64 x;
-  f64 y;
-  b8 hover;
-  b8 highlight;
-  f64 distance;
-  f64 weight;
-
-  f64 drag_x;
-  f64 drag_y;
-} Node;
+  b8 valid;
+  b8 flat;
+  i64 capacity;
+  i64 num_components;
+  i64 *parent;
+  u8 *rank;
+} Components;
 
+// Nodes and edges are stored as structure of arrays indexed by slot.
+// Slots below num_nodes / num_edges have been used at least once, and
+// the enabled bitsets tell which of them are live. Arrays grow on
+// demand, bitsets hold one bit per slot. Freed slots are kept on a
+// stack and reused first, nodes_alive / edges_alive count live slots.
+// Live nodes are also bucketed by center in node_grid, and live edges
+// by the cells their capsule touches in edge_grid, for picking.
+//
+// Every edge has a weight, 1 by default, stored as f32 or, once
+// quantized, as a u16 multiple of weight_step. edge_cost caches what the
+// path engines read: the Euclidean length of every edge, or its weight
+// in weighted mode. Edges are marked stale when they are added, their
+// weight changes or an endpoint moves, and stale entries are recomputed
+// together on the next get_edge_costs.
+//
+// Edges always go from src to dst, but only the strong components and
+// the maximum flow read the direction, and only in directed mode. The
+// other engines treat every edge as undirected.
+//
+// topology_version is bumped whenever nodes or edges are added or
+// removed, geometry_version whenever a node moves or edge costs change.
+// Derived data records the versions it was computed at. Versions start
+// at 1, so a zero tag is never current.
 typedef struct {
-  Node nodes[MAX_NUM_NODES];
-  Edge edges[MAX_NUM_EDGES];
-  i64 path[MAX_PATH_SIZE];
+  u64 topology_version;
+  u64 geometry_version;
+
+  i64 nodes_capacity;
+  i64 num_nodes;
+  i64 nodes_alive;
+  i64 num_free_nodes;
+  i64 *free_nodes;
+  f64 *node_x;
+  f64 *node_y;
+  f32 *node_radius;
+  u64 *node_enabled;
+  u64 *node_hover;
+  u64 *node_highlight;
+  f64 max_radius;
+  i64 hover_node;
+  Grid node_grid;
+
+  i64 edges_capacity;
+  i64 num_edges;
+  i64 edges_alive;
+  i64 num_free_edges;
+  i64 *free_edges;
+  i64 *edge_src;
+  i64 *edge_dst;
+  f32 *edge_width;
+  u64 *edge_enabled;
+  u64 *edge_hover;
+  u64 *edge_highlight;
+  i64 hover_edge;
+  Grid edge_grid;
+
+  b8 weighted;
+  b8 weights_quantized;
+  f32 weight_step;
+  f32 *edge_weight;
+  u16 *edge_weight_quantized;
+
+  b8 directed;
+
+  f64 *edge_cost;
+  u64 *edge_cost_stale;
+  i64 num_stale_edges;
+  i64 *stale_edges;
+
+  // Edges of the highlighted paths, each from dst back to src, one after
+  // the other. Path p is path[path_offsets[p]] up to path_offsets[p + 1].
+  // Then the query and versions they were computed for.
+  i64 path_capacity;
   i64 path_size;
+  i64 *path;
+  i64 path_offsets_capacity;
+  i64 num_paths;
+  i64 *path_offsets;
+  i64 path_src;
+  i64 path_dst;
+  i64 path_mode;
+  u64 path_topology_version;
+  u64 path_geometry_version;
+
+  Adjacency adjacency;
+  Adjacency out_adjacency;
+  Adjacency in_adjacency;
+  Components components;
 } Graph;
 
-Graph graph = {0};
+Graph graph = {
+    .topology_version = 1,
+    .geometry_version = 1,
+    .hover_node = -1,
+    .node_grid = {.cell_size = NODE_GRID_CELL_SIZE},
+    .hover_edge = -1,
+    .edge_grid = {.cell_size = NODE_GRID_CELL_SIZE},
+};
+
+void reserve_nodes(Graph *graph, i64 capacity) {
+  i64 old = graph->nodes_capacity;
+  if (capacity <= old)
+    return;
 
-void add_node(f64 x, f64 y) {
-  for (i64 j = 0; j < MAX_NUM_NODES; ++j) {
-    Node n2 = graph.nodes[j];
-    if (!n2.enabled) {
+  i64 cap = old > 0 ? old : 256;
+  while (cap < capacity)
+    cap *= 2;
+
+  graph->node_x = resize_array(graph->node_x, old, cap, sizeof(f64));
+  graph->node_y = resize_array(graph->node_y, old, cap, sizeof(f64));
+  graph->node_radius = resize_array(graph->node_radius, old, cap, sizeof(f32));
+  graph->free_nodes = resize_array(graph->free_nodes, old, cap, sizeof(i64));
+
+  i64 w0 = bitset_words(old);
+  i64 w1 = bitset_words(cap);
+  graph->node_enabled = resize_array(graph->node_enabled, w0, w1, sizeof(u64));
+  graph->node_hover = resize_array(graph->node_hover, w0, w1, sizeof(u64));
+  graph->node_highlight =
+      resize_array(graph->node_highlight, w0, w1, sizeof(u64));
+
+  graph->nodes_capacity = cap;
+}
+
+void reserve_edges(Graph *graph, i64 capacity) {
+  i64 old = graph->edges_capacity;
+  if (capacity <= old)
+    return;
+
+  i64 cap = old > 0 ? old : 256;
+  while (cap < capacity)
+    cap *= 2;
+
+  graph->edge_src = resize_array(graph->edge_src, old, cap, sizeof(i64));
+  graph->edge_dst = resize_array(graph->edge_dst, old, cap, sizeof(i64));
+  graph->edge_width = resize_array(graph->edge_width, old, cap, sizeof(f32));
+  graph->free_edges = resize_array(graph->free_edges, old, cap, sizeof(i64));
+  graph->edge_cost = resize_array(graph->edge_cost, old, cap, sizeof(f64));
+
+  // Only the weight storage in use is grown
+  if (graph->weights_quantized)
+    graph->edge_weight_quantized = resize_array(
+        graph->edge_weight_quantized, old, cap, sizeof(u16));
+  else
+    graph->edge_weight =
+        resize_array(graph->edge_weight, old, cap, sizeof(f32));
+  graph->stale_edges = resize_array(graph->stale_edges, old, cap, sizeof(i64));
+
+  i64 w0 = bitset_words(old);
+  i64 w1 = bitset_words(cap);
+  graph->edge_enabled = resize_array(graph->edge_enabled, w0, w1, sizeof(u64));
+  graph->edge_hover = resize_array(graph->edge_hover, w0, w1, sizeof(u64));
+  graph->edge_highlight =
+      resize_array(graph->edge_highlight, w0, w1, sizeof(u64));
+  graph->edge_cost_stale =
+      resize_array(graph->edge_cost_stale, w0, w1, sizeof(u64));
+
+  graph->edges_capacity = cap;
+}
+
+void reserve_path(Graph *graph, i64 capacity) {
+  i64 old = graph->path_capacity;
+  if (capacity <= old)
+    return;
+
+  i64 cap = old > 0 ? old : 256;
+  while (cap < capacity)
+    cap *= 2;
+
+  graph->path = resize_array(graph->path, old, cap, sizeof(i64));
+  graph->path_capacity = cap;
+}
+
+void reserve_path_offsets(Graph *graph, i64 capacity) {
+  i64 old = graph->path_offsets_capacity;
+  if (capacity <= old)
+    return;
+
+  i64 cap = old > 0 ? old : 8;
+  while (cap < capacity)
+    cap *= 2;
+
+  graph->path_offsets =
+      resize_array(graph->path_offsets, old, cap, sizeof(i64));
+  graph->path_offsets_capacity = cap;
+}
+
+// Drop every path, the next edges pushed start the first one.
+void clear_paths(Graph *graph) {
+  reserve_path_offsets(graph, 1);
+  graph->path_size = 0;
+  graph->num_paths = 0;
+  graph->path_offsets[0] = 0;
+}
+
+void push_path_edge(Graph *graph, i64 edge_idx) {
+  reserve_path(graph, graph->path_size + 1);
+  graph->path[graph->path_size++] = edge_idx;
+}
+
+// Close the path made of the edges pushed since the last one.
+void finish_path(Graph *graph) {
+  reserve_path_offsets(graph, graph->num_paths + 2);
+  graph->path_offsets[++graph->num_paths] = graph->path_size;
+}
+
+/*************/
+/* ADJACENCY */
+/*************/
+
+b8 adjacency_includes(Graph *graph, i64 edge_idx) {
+  i64 src = graph->edge_src[edge_idx];
+  i64 dst = graph->edge_dst[edge_idx];
+
+  return bit_get(graph->edge_enabled, edge_idx) && src != dst &&
+         bit_get(graph->node_enabled, src) && bit_get(graph->node_enabled, dst);
+}
+
+void build_adjacency(Graph *graph, Adjacency *adj, i64 direction) {
+  i64 num_nodes = graph->num_nodes;
+  b8 at_src = direction != ADJACENCY_IN;
+  b8 at_dst = direction != ADJACENCY_OUT;
+  i64 per_edge = at_src + at_dst;
+
+  // Offsets hold one more entry than there are nodes, even for none
+  if (adj->offsets == NULL || adj->nodes_capacity < graph->nodes_capacity) {
+    adj->offsets = resize_array(adj->offsets, 0, graph->nodes_capacity + 1,
+                                sizeof(i64));
+    adj->nodes_capacity = graph->nodes_capacity;
+  }
+
+  if (adj->edges_capacity < graph->edges_capacity) {
+    adj->neighbors = resize_array(adj->neighbors, 0,
+                                  graph->edges_capacity * per_edge,
+                                  sizeof(i64));
+    adj->edge_ids = resize_array(adj->edge_ids, 0,
+                                 graph->edges_capacity * per_edge,
+                                 sizeof(i64));
+    adj->edges_capacity = graph->edges_capacity;
+  }
+
+  for (i64 i = 0; i <= num_nodes; ++i)
+    adj->offsets[i] = 0;
+
+  // Count the degree of every node, shifted by one slot
+  for (i64 i = 0; i < graph->num_edges; ++i) {
+    if (!adjacency_includes(graph, i))
+      continue;
+
+    if (at_src)
+      adj->offsets[graph->edge_src[i] + 1]++;
+    if (at_dst)
+      adj->offsets[graph->edge_dst[i] + 1]++;
+  }
+
+  for (i64 i = 0; i < num_nodes; ++i)
+    adj->offsets[i + 1] += adj->offsets[i];
+
+  // Scatter, using offsets[i] as the fill cursor of node i
+  for (i64 i = 0; i < graph->num_edges; ++i) {
+    if (!adjacency_includes(graph, i))
       continue;
+
+    i64 src = graph->edge_src[i];
+    i64 dst = graph->edge_dst[i];
+
+    if (at_src) {
+      i64 k = adj->offsets[src]++;
+      adj->neighbors[k] = dst;
+      adj->edge_ids[k] = i;
     }
 
-    if (fabs(x - n2.x) < 50 + n2.radius && fabs(y - n2.y) < 50 + n2.radius) {
-      printf("Error: Cannot add node, overlapping nodes detected.\n");
-      return;
+    if (at_dst) {
+      i64 k = adj->offsets[dst]++;
+      adj->neighbors[k] = src;
+      adj->edge_ids[k] = i;
     }
   }
 
-  for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-    if (!graph.nodes[i].enabled) {
-      graph.nodes[i] = (Node){
-          .enabled = 1,
-          .x = x,
-          .y = y,
-          .radius = 50,
-          .weight = 2,
-      };
+  // Cursors now point at the end of each range, shift them back
+  for (i64 i = num_nodes; i > 0; --i)
+    adj->offsets[i] = adj->offsets[i - 1];
+  adj->offsets[0] = 0;
+
+  adj->version = graph->topology_version;
+}
 
+Adjacency *get_adjacency(Graph *graph) {
+  if (graph->adjacency.version != graph->topology_version)
+    build_adjacency(graph, &graph->adjacency, ADJACENCY_BOTH);
+
+  return &graph->adjacency;
+}
+
+// Edges leaving every node, by source.
+Adjacency *get_out_adjacency(Graph *graph) {
+  if (graph->out_adjacency.version != graph->topology_version)
+    build_adjacency(graph, &graph->out_adjacency, ADJACENCY_OUT);
+
+  return &graph->out_adjacency;
+}
+
+// Edges entering every node, by destination.
+Adjacency *get_in_adjacency(Graph *graph) {
+  if (graph->in_adjacency.version != graph->topology_version)
+    build_adjacency(graph, &graph->in_adjacency, ADJACENCY_IN);
+
+  return &graph->in_adjacency;
+}
+
+/****************/
+/* CONNECTIVITY */
+/****************/
+
+void components_reserve(Components *comp, i64 capacity) {
+  if (comp->capacity >= capacity)
+    return;
+
+  comp->parent =
+      resize_array(comp->parent, comp->capacity, capacity, sizeof(i64));
+  comp->rank = resize_array(comp->rank, comp->capacity, capacity, sizeof(u8));
+  comp->capacity = capacity;
+}
+
+void component_add_node(Components *comp, i64 node_idx) {
+  comp->parent[node_idx] = node_idx;
+  comp->rank[node_idx] = 0;
+  comp->num_components++;
+}
+
+i64 find_component(Components *comp, i64 node_idx) {
+  i64 root = node_idx;
+  while (comp->parent[root] != root)
+    root = comp->parent[root];
+
+  // Point the whole chain at the root
+  while (comp->parent[node_idx] != root) {
+    i64 next = comp->parent[node_idx];
+    comp->parent[node_idx] = root;
+    node_idx = next;
+  }
+
+  return root;
+}
+
+void union_components(Components *comp, i64 a, i64 b) {
+  a = find_component(comp, a);
+  b = find_component(comp, b);
+  if (a == b)
+    return;
+
+  if (comp->rank[a] < comp->rank[b]) {
+    i64 t = a;
+    a = b;
+    b = t;
+  }
+
+  comp->parent[b] = a;
+  if (comp->rank[a] == comp->rank[b])
+    comp->rank[a]++;
+
+  comp->num_components--;
+  comp->flat = 0;
+}
+
+void build_components(Graph *graph) {
+  Components *comp = &graph->components;
+  components_reserve(comp, graph->nodes_capacity);
+
+  comp->num_components = 0;
+  for (i64 i = 0; i < graph->num_nodes; ++i)
+    if (bit_get(graph->node_enabled, i))
+      component_add_node(comp, i);
+
+  for (i64 i = 0; i < graph->num_edges; ++i)
+    if (adjacency_includes(graph, i))
+      union_components(comp, graph->edge_src[i], graph->edge_dst[i]);
+
+  comp->valid = 1;
+  comp->flat = 0;
+}
+
+Components *get_components(Graph *graph) {
+  if (!graph->components.valid)
+    build_components(graph);
+
+  return &graph->components;
+}
+
+b8 nodes_connected(Graph *graph, i64 a, i64 b) {
+  Components *comp = get_components(graph);
+
+  return find_component(comp, a) == find_component(comp, b);
+}
+
+// Point every node straight at its root and return the parents, which
+// then name the component of each node.
+i64 *flatten_components(Graph *graph) {
+  Components *comp = get_components(graph);
+
+  if (!comp->flat) {
+    for (i64 i = 0; i < graph->num_nodes; ++i)
+      if (bit_get(graph->node_enabled, i))
+        find_component(comp, i);
+    comp->flat = 1;
+  }
+
+  return comp->parent;
+}
+
+/****************/
+/* EDGE LENGTHS */
+/****************/
+
+void mark_edge_cost_stale(Graph *graph, i64 edge_idx) {
+  if (bit_get(graph->edge_cost_stale, edge_idx))
+    return;
+
+  bit_set(graph->edge_cost_stale, edge_idx, 1);
+  graph->stale_edges[graph->num_stale_edges++] = edge_idx;
+}
+
+// Lengths of the listed edges, two at a time with SSE2 where available.
+void compute_edge_lengths(Graph *graph, i64 *edges, i64 count) {
+  f64 *x = graph->node_x;
+  f64 *y = graph->node_y;
+  i64 *src = graph->edge_src;
+  i64 *dst = graph->edge_dst;
+  i64 i = 0;
+
+#ifdef __SSE2__
+  for (; i + 2 <= count; i += 2) {
+    i64 e0 = edges[i];
+    i64 e1 = edges[i + 1];
+
+    __m128d dx = _mm_sub_pd(_mm_set_pd(x[dst[e1]], x[dst[e0]]),
+                            _mm_set_pd(x[src[e1]], x[src[e0]]));
+    __m128d dy = _mm_sub_pd(_mm_set_pd(y[dst[e1]], y[dst[e0]]),
+                            _mm_set_pd(y[src[e1]], y[src[e0]]));
+    __m128d length = _mm_sqrt_pd(
+        _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+
+    _mm_storel_pd(&graph->edge_cost[e0], length);
+    _mm_storeh_pd(&graph->edge_cost[e1], length);
+  }
+#endif
+
+  for (; i < count; ++i) {
+    i64 e = edges[i];
+    f64 dx = x[dst[e]] - x[src[e]];
+    f64 dy = y[dst[e]] - y[src[e]];
+
+    graph->edge_cost[e] = sqrt(dx * dx + dy * dy);
+  }
+}
+
+/***********/
+/* WEIGHTS */
+/***********/
+
+f64 get_edge_weight(Graph *graph, i64 edge_idx) {
+  if (graph->weights_quantized)
+    return graph->edge_weight_quantized[edge_idx] * (f64)graph->weight_step;
+
+  return graph->edge_weight[edge_idx];
+}
+
+u16 quantize_weight(f64 weight, f64 step) {
+  f64 q = floor(weight / step + .5);
+
+  // Keep positive weights positive
+  if (q < 1 && weight > 0)
+    q = 1;
+  if (q > MAX_QUANTIZED_WEIGHT)
+    q = MAX_QUANTIZED_WEIGHT;
+
+  return (u16)q;
+}
+
+// Switch weight storage between f32 and u16, or requantize with a step
+// fitting max_weight. Quantized weights lose precision to a fixed step,
+// 1/65535 of the largest weight.
+void quantize_edge_weights(Graph *graph, b8 quantized, f64 max_weight) {
+  i64 cap = graph->edges_capacity;
+
+  if (!quantized) {
+    if (!graph->weights_quantized)
       return;
-    }
+
+    graph->edge_weight = resize_array(NULL, 0, cap, sizeof(f32));
+    for (i64 i = 0; i < graph->num_edges; ++i)
+      graph->edge_weight[i] = get_edge_weight(graph, i);
+
+    free(graph->edge_weight_quantized);
+    graph->edge_weight_quantized = NULL;
+    graph->weights_quantized = 0;
+  } else {
+    for (i64 i = 0; i < graph->num_edges; ++i)
+      if (bit_get(graph->edge_enabled, i) &&
+          max_weight < get_edge_weight(graph, i))
+        max_weight = get_edge_weight(graph, i);
+
+    f64 step = max_weight > 0 ? max_weight / MAX_QUANTIZED_WEIGHT : 1;
+    u16 *q = resize_array(NULL, 0, cap, sizeof(u16));
+
+    for (i64 i = 0; i < graph->num_edges; ++i)
+      q[i] = quantize_weight(get_edge_weight(graph, i), step);
+
+    free(graph->edge_weight);
+    free(graph->edge_weight_quantized);
+    graph->edge_weight = NULL;
+    graph->edge_weight_quantized = q;
+    graph->weight_step = step;
+    graph->weights_quantized = 1;
+  }
+
+  for (i64 i = 0; i < graph->num_edges; ++i)
+    mark_edge_cost_stale(graph, i);
+  graph->geometry_version++;
+}
+
+// Weights are positive, a weight beyond the quantized range requantizes
+// every edge with a larger step.
+void set_edge_weight(Graph *graph, i64 edge_idx, f64 weight) {
+  assert(weight > 0);
+
+  if (graph->weights_quantized) {
+    if (weight > graph->weight_step * (f64)MAX_QUANTIZED_WEIGHT)
+      quantize_edge_weights(graph, 1, weight);
+
+    graph->edge_weight_quantized[edge_idx] =
+        quantize_weight(weight, graph->weight_step);
+  } else {
+    graph->edge_weight[edge_idx] = (f32)weight;
   }
+
+  mark_edge_cost_stale(graph, edge_idx);
+  graph->geometry_version++;
+}
+
+// Switch the path engines between Euclidean lengths and edge weights.
+void set_weighted(Graph *graph, b8 weighted) {
+  if (graph->weighted == weighted)
+    return;
+
+  graph->weighted = weighted;
+
+  for (i64 i = 0; i < graph->num_edges; ++i)
+    mark_edge_cost_stale(graph, i);
+  graph->geometry_version++;
+}
+
+// Bring the stale costs up to date. Every algorithm reading costs goes
+// through here or through a view.
+f64 *get_edge_costs(Graph *graph) {
+  if (graph->weighted)
+    for (i64 i = 0; i < graph->num_stale_edges; ++i)
+      graph->edge_cost[graph->stale_edges[i]] =
+          get_edge_weight(graph, graph->stale_edges[i]);
+  else
+    compute_edge_lengths(graph, graph->stale_edges, graph->num_stale_edges);
+
+  for (i64 i = 0; i < graph->num_stale_edges; ++i)
+    bit_set(graph->edge_cost_stale, graph->stale_edges[i], 0);
+  graph->num_stale_edges = 0;
+
+  return graph->edge_cost;
+}
+
+// Arrays a path search reads, taken after the adjacency, the edge costs
+// and the components are brought up to date. Nothing is written through
+// a view, so any number of threads may search the same one at once, as
+// long as the graph is not edited meanwhile.
+typedef struct {
+  i64 num_nodes;
+  f64 *node_x;
+  f64 *node_y;
+  u64 *node_enabled;
+  i64 *edge_src;
+  i64 *edge_dst;
+  i64 *offsets;
+  i64 *neighbors;
+  i64 *edge_ids;
+  f64 *edge_cost;
+  b8 weighted;
+  i64 *component;
+} Graph_View;
+
+Graph_View get_graph_view(Graph *graph) {
+  Adjacency *adj = get_adjacency(graph);
+
+  return (Graph_View){
+      .num_nodes = graph->num_nodes,
+      .node_x = graph->node_x,
+      .node_y = graph->node_y,
+      .node_enabled = graph->node_enabled,
+      .edge_src = graph->edge_src,
+      .edge_dst = graph->edge_dst,
+      .offsets = adj->offsets,
+      .neighbors = adj->neighbors,
+      .edge_ids = adj->edge_ids,
+      .edge_cost = get_edge_costs(graph),
+      .weighted = graph->weighted,
+      .component = flatten_components(graph),
+  };
 }
 
 /*********/
-/* EDGES */
+/* NODES */
 /*********/
 
-void add_edge(i64 src, i64 dst) {
-  assert(src >= 0 && src < MAX_NUM_NODES);
-  assert(dst >= 0 && dst < MAX_NUM_NODES);
+void grid_insert_node(Graph *graph, i64 node_index) {
+  f64 x = graph->node_x[node_index];
+  f64 y = graph->node_y[node_index];
 
-  for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-    if (!graph.edges[i].enabled) {
-      graph.edges[i] = (Edge){
-          .enabled = 1,
-          .src = src,
-          .dst = dst,
-          .width = 35,
-      };
+  grid_insert(&graph->node_grid, node_index, x, y, x, y);
+}
 
-      return;
+void grid_remove_node(Graph *graph, i64 node_index) {
+  f64 x = graph->node_x[node_index];
+  f64 y = graph->node_y[node_index];
+
+  grid_remove(&graph->node_grid, node_index, x, y, x, y);
+}
+
+// Return the lowest index live node whose center is within the box
+// around (x, y) extended by margin plus the node radius, and for which
+// the contains test holds. Only the grid cells near the box are visited.
+i64 find_node_near(Graph *graph, f64 x, f64 y, f64 margin,
+                   b8 (*contains)(Graph *, i64, f64, f64, f64)) {
+  Grid *grid = &graph->node_grid;
+  f64 reach = margin + graph->max_radius;
+  i64 cx1 = grid_coord(grid, x + reach);
+  i64 cy1 = grid_coord(grid, y + reach);
+  i64 found = -1;
+
+  for (i64 cy = grid_coord(grid, y - reach); cy <= cy1; ++cy)
+    for (i64 cx = grid_coord(grid, x - reach); cx <= cx1; ++cx) {
+      Grid_Cell *cell = grid_lookup(grid, cx, cy);
+      if (cell == NULL)
+        continue;
+
+      for (i64 k = 0; k < cell->size; ++k) {
+        i64 i = cell->items[k];
+        if ((found < 0 || i < found) && contains(graph, i, x, y, margin))
+          found = i;
+      }
     }
+
+  return found;
+}
+
+b8 node_overlaps(Graph *graph, i64 i, f64 x, f64 y, f64 margin) {
+  f64 r = graph->node_radius[i];
+
+  return fabs(x - graph->node_x[i]) < margin + r &&
+         fabs(y - graph->node_y[i]) < margin + r;
+}
+
+b8 node_contains(Graph *graph, i64 i, f64 x, f64 y, f64 margin) {
+  f64 r = graph->node_radius[i];
+
+  return ellipse_contains(graph->node_x[i] - r, graph->node_y[i] - r, r * 2,
+                          r * 2, x, y);
+}
+
+// Node under the point, or -1.
+i64 node_at(Graph *graph, f64 x, f64 y) {
+  return find_node_near(graph, x, y, 0, node_contains);
+}
+
+void grid_update_edge(Graph *graph, i64 edge_index, b8 insert) {
+  i64 src = graph->edge_src[edge_index];
+  i64 dst = graph->edge_dst[edge_index];
+
+  grid_update_segment(&graph->edge_grid, edge_index, graph->node_x[src],
+                      graph->node_y[src], graph->node_x[dst],
+                      graph->node_y[dst], graph->edge_width[edge_index] * .5,
+                      insert);
+}
+
+// Edge under the point, or -1. Edges are listed in every cell they
+// touch, so only the cell of the point is visited.
+i64 edge_at(Graph *graph, f64 x, f64 y) {
+  Grid *grid = &graph->edge_grid;
+  Grid_Cell *cell = grid_lookup(grid, grid_coord(grid, x), grid_coord(grid, y));
+  i64 found = -1;
+
+  if (cell == NULL)
+    return -1;
+
+  for (i64 k = 0; k < cell->size; ++k) {
+    i64 i = cell->items[k];
+    i64 src = graph->edge_src[i];
+    i64 dst = graph->edge_dst[i];
+
+    if ((found < 0 || i < found) &&
+        line_contains(graph->node_x[src], graph->node_y[src],
+                      graph->node_x[dst], graph->node_y[dst],
+                      graph->edge_width[i], x, y))
+      found = i;
   }
+
+  return found;
 }
 
-void remove_node() {
-  for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-    Node n = graph.nodes[i];
+i64 add_node(f64 x, f64 y) {
+  if (find_node_near(&graph, x, y, 50, node_overlaps) >= 0) {
+    printf("Error: Cannot add node, overlapping nodes detected.\n");
+    return -1;
+  }
 
-    if (n.enabled && n.hover) {
-      graph.nodes[i].enabled = 0;
+  i64 i;
+  b8 reused = graph.num_free_nodes > 0;
 
-      for (i64 j = 0; j < MAX_NUM_EDGES; ++j) {
-        Edge e = graph.edges[j];
+  if (reused) {
+    i = graph.free_nodes[--graph.num_free_nodes];
+  } else {
+    i = graph.num_nodes;
+    reserve_nodes(&graph, i + 1);
+    graph.num_nodes++;
+  }
 
-        if (e.src == i || e.dst == i) {
-          graph.edges[j].enabled = 0;
-        }
-      }
+  graph.nodes_alive++;
+  graph.topology_version++;
 
-      return;
+  graph.node_x[i] = x;
+  graph.node_y[i] = y;
+  graph.node_radius[i] = 50;
+  bit_set(graph.node_enabled, i, 1);
+  bit_set(graph.node_hover, i, 0);
+  bit_set(graph.node_highlight, i, 0);
+
+  if (graph.max_radius < graph.node_radius[i])
+    graph.max_radius = graph.node_radius[i];
+
+  grid_insert_node(&graph, i);
+
+  // delete_node takes the edges of a node with it, but add_edge accepts a
+  // free slot, and edges added to it while it was free count again once
+  // it is reused. So a reused slot needs a rebuild.
+  if (reused) {
+    graph.components.valid = 0;
+  } else if (graph.components.valid) {
+    components_reserve(&graph.components, graph.nodes_capacity);
+    component_add_node(&graph.components, i);
+  }
+
+  return i;
+}
+
+void move_node(i64 node_index, f64 x, f64 y) {
+  assert(node_index >= 0 && node_index < graph.num_nodes);
+
+  Adjacency *adj = get_adjacency(&graph);
+  i64 k0 = adj->offsets[node_index];
+  i64 k1 = adj->offsets[node_index + 1];
+
+  for (i64 k = k0; k < k1; ++k)
+    grid_update_edge(&graph, adj->edge_ids[k], 0);
+
+  Grid *grid = &graph.node_grid;
+  f64 x0 = graph.node_x[node_index];
+  f64 y0 = graph.node_y[node_index];
+  b8 same_cell = grid_coord(grid, x0) == grid_coord(grid, x) &&
+                 grid_coord(grid, y0) == grid_coord(grid, y);
+
+  if (!same_cell)
+    grid_remove_node(&graph, node_index);
+
+  graph.node_x[node_index] = x;
+  graph.node_y[node_index] = y;
+  graph.geometry_version++;
+
+  if (!same_cell)
+    grid_insert_node(&graph, node_index);
+
+  for (i64 k = k0; k < k1; ++k) {
+    grid_update_edge(&graph, adj->edge_ids[k], 1);
+    mark_edge_cost_stale(&graph, adj->edge_ids[k]);
+  }
+}
+
+// Move many nodes at once. Past a quarter of the live nodes the grids
+// are rebuilt in one pass, which is cheaper than taking every incident
+// edge out and back in, twice for edges with both ends moving.
+void move_nodes(i64 count, i64 *nodes, f64 *x, f64 *y) {
+  if (count * 4 < graph.nodes_alive) {
+    for (i64 i = 0; i < count; ++i)
+      move_node(nodes[i], x[i], y[i]);
+    return;
+  }
+
+  for (i64 i = 0; i < count; ++i) {
+    graph.node_x[nodes[i]] = x[i];
+    graph.node_y[nodes[i]] = y[i];
+  }
+  graph.geometry_version++;
+
+  grid_clear(&graph.node_grid);
+  grid_clear(&graph.edge_grid);
+
+  for (i64 i = 0; i < graph.num_nodes; ++i)
+    if (bit_get(graph.node_enabled, i))
+      grid_insert_node(&graph, i);
+
+  for (i64 i = 0; i < graph.num_edges; ++i)
+    if (bit_get(graph.edge_enabled, i)) {
+      grid_update_edge(&graph, i, 1);
+      mark_edge_cost_stale(&graph, i);
     }
+}
+
+/*********/
+/* EDGES */
+/*********/
+
+i64 add_edge(i64 src, i64 dst) {
+  assert(src >= 0 && src < graph.num_nodes);
+  assert(dst >= 0 && dst < graph.num_nodes);
+
+  // Self-loops never lie on a path and have nothing to draw
+  if (src == dst)
+    return -1;
+
+  i64 i;
+
+  if (graph.num_free_edges > 0) {
+    i = graph.free_edges[--graph.num_free_edges];
+  } else {
+    i = graph.num_edges;
+    reserve_edges(&graph, i + 1);
+    graph.num_edges++;
   }
+
+  graph.edges_alive++;
+
+  graph.edge_src[i] = src;
+  graph.edge_dst[i] = dst;
+  graph.edge_width[i] = 35;
+  bit_set(graph.edge_enabled, i, 1);
+  bit_set(graph.edge_hover, i, 0);
+  bit_set(graph.edge_highlight, i, 0);
+  graph.topology_version++;
+
+  grid_update_edge(&graph, i, 1);
+
+  if (graph.components.valid && adjacency_includes(&graph, i))
+    union_components(&graph.components, src, dst);
+
+  // Cleared first so a reused slot does not count towards requantizing
+  if (graph.weights_quantized)
+    graph.edge_weight_quantized[i] = 0;
+  set_edge_weight(&graph, i, 1);
+
+  return i;
+}
+
+void delete_edge(i64 edge_index) {
+  assert(edge_index >= 0 && edge_index < graph.num_edges);
+
+  if (!bit_get(graph.edge_enabled, edge_index))
+    return;
+
+  grid_update_edge(&graph, edge_index, 0);
+
+  bit_set(graph.edge_enabled, edge_index, 0);
+  bit_set(graph.edge_hover, edge_index, 0);
+  bit_set(graph.edge_highlight, edge_index, 0);
+  if (graph.hover_edge == edge_index)
+    graph.hover_edge = -1;
+  graph.free_edges[graph.num_free_edges++] = edge_index;
+  graph.edges_alive--;
+  graph.topology_version++;
+  graph.components.valid = 0;
+}
+
+void delete_node(i64 node_index) {
+  assert(node_index >= 0 && node_index < graph.num_nodes);
+
+  if (!bit_get(graph.node_enabled, node_index))
+    return;
+
+  Adjacency *adj = get_adjacency(&graph);
+
+  for (i64 k = adj->offsets[node_index]; k < adj->offsets[node_index + 1]; ++k)
+    delete_edge(adj->edge_ids[k]);
+
+  grid_remove_node(&graph, node_index);
+
+  bit_set(graph.node_enabled, node_index, 0);
+  bit_set(graph.node_hover, node_index, 0);
+  bit_set(graph.node_highlight, node_index, 0);
+  if (graph.hover_node == node_index)
+    graph.hover_node = -1;
+  graph.free_nodes[graph.num_free_nodes++] = node_index;
+  graph.nodes_alive--;
+  graph.topology_version++;
+  graph.components.valid = 0;
+}
+
+void remove_node() {
+  if (graph.hover_node >= 0)
+    delete_node(graph.hover_node);
 }
 
 void remove_edge() {
-  for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-    Edge e = graph.edges[i];
+  if (graph.hover_edge >= 0)
+    delete_edge(graph.hover_edge);
+}
 
-    if (e.enabled && e.hover) {
-      graph.edges[i].enabled = 0;
+// Pick the edge under the cursor into hover_edge and the hover bitset.
+// Edges are not hovered while a node is.
+void update_edge_hover() {
+  if (graph.hover_edge >= 0)
+    bit_set(graph.edge_hover, graph.hover_edge, 0);
 
-      return;
+  graph.hover_edge = -1;
+
+  if (graph.hover_node < 0)
+    graph.hover_edge = edge_at(&graph, platform.cursor_x, platform.cursor_y);
+
+  if (graph.hover_edge >= 0)
+    bit_set(graph.edge_hover, graph.hover_edge, 1);
+}
+
+i32 edges_count() { return (i32)graph.edges_alive; }
+
+// Pick the node under the cursor into hover_node and the hover bitset.
+void update_node_hover() {
+  if (graph.hover_node >= 0)
+    bit_set(graph.node_hover, graph.hover_node, 0);
+
+  graph.hover_node = node_at(&graph, platform.cursor_x, platform.cursor_y);
+
+  if (graph.hover_node >= 0)
+    bit_set(graph.node_hover, graph.hover_node, 1);
+}
+
+i32 nodes_count() { return (i32)graph.nodes_alive; }
+
+/**************/
+/* COMPACTION */
+/**************/
+
+u64 fingerprint_mix(u64 h, u64 v) {
+  h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  return h * 0xff51afd7ed558ccdull;
+}
+
+// Hash of the live nodes and edges with their slots, exact coordinates
+// and, in weighted mode, weights.
+// Data derived from the graph and saved with it is tagged with this, since
+// versions do not survive a reload. save_graph leaves the graph as the
+// file holds it, so only hashes taken after saving match on reload.
+u64 graph_fingerprint(Graph *graph) {
+  u64 h = fingerprint_mix(0, graph->num_nodes);
+
+  for (i64 i = 0; i < graph->num_nodes; ++i) {
+    if (!bit_get(graph->node_enabled, i))
+      continue;
+
+    u64 x, y;
+    memcpy(&x, &graph->node_x[i], sizeof x);
+    memcpy(&y, &graph->node_y[i], sizeof y);
+
+    h = fingerprint_mix(h, i);
+    h = fingerprint_mix(h, x);
+    h = fingerprint_mix(h, y);
+  }
+
+  h = fingerprint_mix(h, graph->num_edges);
+
+  for (i64 i = 0; i < graph->num_edges; ++i) {
+    if (!bit_get(graph->edge_enabled, i))
+      continue;
+
+    h = fingerprint_mix(h, i);
+    h = fingerprint_mix(h, graph->edge_src[i]);
+    h = fingerprint_mix(h, graph->edge_dst[i]);
+
+    if (graph->weighted) {
+      f64 weight = get_edge_weight(graph, i);
+      u64 w;
+      memcpy(&w, &weight, sizeof w);
+      h = fingerprint_mix(h, w);
     }
   }
+
+  return fingerprint_mix(h, graph->weighted);
 }
 
-void update_edge(i64 edge_index) {
-  assert(edge_index >= 0 && edge_index < MAX_NUM_EDGES);
-  /* assert(validate_node(graph.edges[edge_index].src)); */
-  /* assert(validate_node(graph.edges[edge_index].dst)); */
+// Move live nodes and edges to the front of their arrays, keeping their
+// order, and empty the free lists. Node and edge indices change, so the
+// path is dropped. If node_remap is not NULL it receives the new index
+// of every old node slot, or -1 for slots that were free.
+void compact_graph(Graph *graph, i64 *node_remap) {
+  i64 *remap = node_remap;
+  if (remap == NULL)
+    remap = resize_array(NULL, 0, graph->num_nodes, sizeof(i64));
+
+  i64 n = 0;
 
-  f64 x = platform.cursor_x;
-  f64 y = platform.cursor_y;
+  for (i64 i = 0; i < graph->num_nodes; ++i) {
+    if (!bit_get(graph->node_enabled, i)) {
+      remap[i] = -1;
+      continue;
+    }
 
-  Edge e = graph.edges[edge_index];
-  Node n0 = graph.nodes[e.src];
-  Node n1 = graph.nodes[e.dst];
+    remap[i] = n;
+    graph->node_x[n] = graph->node_x[i];
+    graph->node_y[n] = graph->node_y[i];
+    graph->node_radius[n] = graph->node_radius[i];
+    bit_set(graph->node_hover, n, bit_get(graph->node_hover, i));
+    bit_set(graph->node_highlight, n, bit_get(graph->node_highlight, i));
+    ++n;
+  }
 
-  graph.edges[edge_index].hover =
-      line_contains(n0.x, n0.y, n1.x, n1.y, e.width, x, y);
-}
+  for (i64 i = 0; i < graph->num_nodes; ++i)
+    bit_set(graph->node_enabled, i, i < n);
+  for (i64 i = n; i < graph->num_nodes; ++i) {
+    bit_set(graph->node_hover, i, 0);
+    bit_set(graph->node_highlight, i, 0);
+  }
+
+  i64 m = 0;
+
+  for (i64 i = 0; i < graph->num_edges; ++i) {
+    if (!bit_get(graph->edge_enabled, i))
+      continue;
+
+    if (graph->hover_edge == i)
+      graph->hover_edge = m;
 
-i32 edges_count() {
-  i32 count = 0;
+    graph->edge_src[m] = remap[graph->edge_src[i]];
+    graph->edge_dst[m] = remap[graph->edge_dst[i]];
+    graph->edge_width[m] = graph->edge_width[i];
+    if (graph->weights_quantized)
+      graph->edge_weight_quantized[m] = graph->edge_weight_quantized[i];
+    else
+      graph->edge_weight[m] = graph->edge_weight[i];
+    bit_set(graph->edge_hover, m, bit_get(graph->edge_hover, i));
+    bit_set(graph->edge_highlight, m, bit_get(graph->edge_highlight, i));
+    ++m;
+  }
 
-  for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-    if (graph.edges[i].enabled)
-      ++count;
+  for (i64 i = 0; i < graph->num_edges; ++i)
+    bit_set(graph->edge_enabled, i, i < m);
+  for (i64 i = m; i < graph->num_edges; ++i) {
+    bit_set(graph->edge_hover, i, 0);
+    bit_set(graph->edge_highlight, i, 0);
   }
 
-  return count;
+  if (graph->hover_node >= 0)
+    graph->hover_node = remap[graph->hover_node];
+
+  if (node_remap == NULL)
+    free(remap);
+
+  graph->num_nodes = n;
+  graph->nodes_alive = n;
+  graph->num_free_nodes = 0;
+  graph->num_edges = m;
+  graph->edges_alive = m;
+  graph->num_free_edges = 0;
+  clear_paths(graph);
+  graph->path_topology_version = 0;
+  graph->topology_version++;
+  graph->components.valid = 0;
+
+  grid_clear(&graph->node_grid);
+  for (i64 i = 0; i < n; ++i)
+    grid_insert_node(graph, i);
+
+  grid_clear(&graph->edge_grid);
+  for (i64 i = 0; i < m; ++i)
+    grid_update_edge(graph, i, 1);
+
+  // Slots changed, so recompute every length in one pass
+  for (i64 i = 0; i < bitset_words(graph->edges_capacity); ++i)
+    graph->edge_cost_stale[i] = 0;
+  graph->num_stale_edges = 0;
+
+  for (i64 i = 0; i < m; ++i)
+    mark_edge_cost_stale(graph, i);
 }
 
+
 /*********/
-/* NODES */
+/* FILES */
 /*********/
 
-void update_node(i64 node_index) {
-	assert(node_index >= 0 && node_index < MAX_NUM_NODES);
-	
-  f64 x = platform.cursor_x;
-  f64 y = platform.cursor_y;
+// Empty the graph, keeping its storage. Weights go back to f32, and
+// both versions move on so nothing derived from the old graph is current.
+void clear_graph(Graph *graph) {
+  quantize_edge_weights(graph, 0, 0);
+
+  for (i64 i = 0; i < bitset_words(graph->nodes_capacity); ++i) {
+    graph->node_enabled[i] = 0;
+    graph->node_hover[i] = 0;
+    graph->node_highlight[i] = 0;
+  }
+
+  for (i64 i = 0; i < bitset_words(graph->edges_capacity); ++i) {
+    graph->edge_enabled[i] = 0;
+    graph->edge_hover[i] = 0;
+    graph->edge_highlight[i] = 0;
+    graph->edge_cost_stale[i] = 0;
+  }
+
+  graph->num_nodes = 0;
+  graph->nodes_alive = 0;
+  graph->num_free_nodes = 0;
+  graph->max_radius = 0;
+  graph->hover_node = -1;
+  graph->num_edges = 0;
+  graph->edges_alive = 0;
+  graph->num_free_edges = 0;
+  graph->hover_edge = -1;
+  graph->num_stale_edges = 0;
+  graph->weighted = 0;
+  graph->directed = 0;
+
+  grid_clear(&graph->node_grid);
+  grid_clear(&graph->edge_grid);
+  clear_paths(graph);
+  graph->path_topology_version = 0;
+  graph->components.valid = 0;
+  graph->topology_version++;
+  graph->geometry_version++;
+}
+
+// Reads 0 past the end of the file.
+i32 readInt(FILE *f) {
+  i32 x = 0;
+  fscanf(f, "%d", &x);
+
+  return x;
+}
+
+void writeInt(FILE *f, i32 value) { fprintf(f, "%d ", value); }
+
+// Weights follow the edges as a mode, then one weight per edge. Mode 0
+// is for geometric lengths, 1 for f32 weights and 3 for quantized ones,
+// written as the step then the multiples of it. Mode 2, quantized
+// weights written as numbers, is still read from older files. Files
+// written before weights have no mode and load as geometric.
+enum {
+  WEIGHTS_NONE = 0,
+  WEIGHTS_F32 = 1,
+  WEIGHTS_QUANTIZED = 2,
+  WEIGHTS_QUANTIZED_STEPS = 3,
+};
+
+// Weights are listed for the edges in file order. edge_slot holds the
+// slot each edge was loaded into, or -1 for edges that were skipped,
+// whose weights are read and dropped.
+void read_weights(FILE *f, i64 *edge_slot, i64 num_edges) {
+  i32 mode;
+  if (fscanf(f, "%d", &mode) != 1 || mode == WEIGHTS_NONE)
+    return;
+
+  f64 step = 0;
+  if (mode == WEIGHTS_QUANTIZED_STEPS) {
+    if (fscanf(f, "%lf", &step) != 1 || !(step > 0)) {
+      printf("Bad weight step in the save file, using f32 weights\n");
+      return;
+    }
+
+    // Taken as is, so every weight comes back exactly as it was saved.
+    // Switching the storage already marks every cost stale.
+    quantize_edge_weights(&graph, 1, 0);
+    graph.weight_step = (f32)step;
+  }
+
+  for (i64 k = 0; k < num_edges; ++k) {
+    i64 i = edge_slot[k];
+
+    if (mode == WEIGHTS_QUANTIZED_STEPS) {
+      i32 q;
+      if (fscanf(f, "%d", &q) != 1 || q < 1 || q > MAX_QUANTIZED_WEIGHT) {
+        printf("Bad edge weight in the save file, using 1 step\n");
+        q = 1;
+      }
+
+      if (i >= 0)
+        graph.edge_weight_quantized[i] = (u16)q;
+      continue;
+    }
+
+    f64 weight;
+    if (fscanf(f, "%lf", &weight) != 1 || !(weight > 0)) {
+      printf("Bad edge weight in the save file, using 1\n");
+      weight = 1;
+    }
 
-  Node n = graph.nodes[node_index];
+    if (i >= 0)
+      set_edge_weight(&graph, i, weight);
+  }
 
-  graph.nodes[node_index].hover =
-      ellipse_contains(n.x - n.radius, n.y - n.radius, n.radius * 2,
-                       n.radius * 2, platform.cursor_x, platform.cursor_y
+  // Quantized once all weights are in, so the step fits the largest
+  if (mode == WEIGHTS_QUANTIZED)
+    quantize_edge_weights(&graph, 1, 0);
 
-      );
+  set_weighted(&graph, 1);
 }
 
-i32 nodes_count() {
-  i32 count = 0;
+// f32 weights print exactly with 9 digits, so both modes read back the
+// weights as they are.
+void write_weights(FILE *f) {
+  if (!graph.weighted) {
+    writeInt(f, WEIGHTS_NONE);
+    return;
+  }
+
+  if (graph.weights_quantized) {
+    writeInt(f, WEIGHTS_QUANTIZED_STEPS);
+    fprintf(f, "%.9g ", graph.weight_step);
 
-  for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-    if (graph.nodes[i].enabled)
-      ++count;
+    for (i64 i = 0; i < graph.num_edges; ++i)
+      if (bit_get(graph.edge_enabled, i))
+        writeInt(f, graph.edge_weight_quantized[i]);
+    return;
   }
 
-  return count;
+  writeInt(f, WEIGHTS_F32);
+
+  for (i64 i = 0; i < graph.num_edges; ++i)
+    if (bit_get(graph.edge_enabled, i))
+      fprintf(f, "%.9g ", graph.edge_weight[i]);
 }
 
+// Replace the graph with the one saved at path. Returns 0 if there is no
+// such file.
+b8 load_graph(c8 *path) {
+  FILE *n = fopen(path, "rb");
+  if (n == NULL)
+    return 0;
+
+  clear_graph(&graph);
+
+  i32 num_nodes = readInt(n);
+  if (num_nodes < 0)
+    num_nodes = 0;
+  reserve_nodes(&graph, num_nodes);
+
+  // Edges name nodes by position in the file. Nodes add_node rejects,
+  // such as overlapping ones, get no slot, so positions are mapped to
+  // the slots actually created.
+  i64 *node_slot = resize_array(NULL, 0, num_nodes, sizeof(i64));
+
+  for (i64 i = 0; i < num_nodes; ++i) {
+    f64 x = readInt(n);
+    f64 y = readInt(n);
+
+    node_slot[i] = add_node(x, y);
+  };
+
+  i32 num_edges = readInt(n);
+  if (num_edges < 0)
+    num_edges = 0;
+  reserve_edges(&graph, num_edges);
+
+  i64 *edge_slot = resize_array(NULL, 0, num_edges, sizeof(i64));
+  i64 skipped = 0;
+
+  for (i64 i = 0; i < num_edges; ++i) {
+    i32 src = readInt(n);
+    i32 dst = readInt(n);
+
+    edge_slot[i] = -1;
+
+    if (src < 0 || src >= num_nodes || dst < 0 || dst >= num_nodes ||
+        node_slot[src] < 0 || node_slot[dst] < 0) {
+      skipped++;
+      continue;
+    }
+
+    edge_slot[i] = add_edge(node_slot[src], node_slot[dst]);
+  };
+
+  if (skipped > 0)
+    printf("Error: Skipped %lld edges with nodes that failed to load.\n",
+           skipped);
+
+  read_weights(n, edge_slot, num_edges);
+
+  free(node_slot);
+  free(edge_slot);
+
+  // Older files end before the directed flag
+  i32 directed;
+  if (fscanf(n, "%d", &directed) == 1)
+    graph.directed = directed != 0;
+
+  fclose(n);
+
+  return 1;
+}
+
+// Save the graph to path. The file holds whole coordinates and edges by
+// node position, so the graph is first compacted and its nodes moved to
+// the coordinates written. The graph in memory is then the one the file
+// loads back as, and data tagged with graph_fingerprint afterwards
+// matches the reloaded graph.
+b8 save_graph(c8 *path) {
+  compact_graph(&graph, NULL);
+
+  i64 *moved = resize_array(NULL, 0, graph.num_nodes, sizeof(i64));
+  f64 *moved_x = resize_array(NULL, 0, graph.num_nodes, sizeof(f64));
+  f64 *moved_y = resize_array(NULL, 0, graph.num_nodes, sizeof(f64));
+  i64 num_moved = 0;
+
+  for (i64 i = 0; i < graph.num_nodes; ++i) {
+    f64 x = (i32)graph.node_x[i];
+    f64 y = (i32)graph.node_y[i];
+
+    if (x != graph.node_x[i] || y != graph.node_y[i]) {
+      moved[num_moved] = i;
+      moved_x[num_moved] = x;
+      moved_y[num_moved] = y;
+      ++num_moved;
+    }
+  }
+
+  if (num_moved > 0)
+    move_nodes(num_moved, moved, moved_x, moved_y);
+
+  free(moved);
+  free(moved_x);
+  free(moved_y);
+
+  FILE *n = fopen(path, "wb");
+  if (n == NULL) {
+    printf("Error: Cannot write %s.\n", path);
+    return 0;
+  }
+
+  writeInt(n, nodes_count());
+
+  for (i64 i = 0; i < graph.num_nodes; ++i) {
+    writeInt(n, (i32)graph.node_x[i]);
+    writeInt(n, (i32)graph.node_y[i]);
+  };
+
+  writeInt(n, edges_count());
+
+  for (i64 i = 0; i < graph.num_edges; ++i) {
+    writeInt(n, graph.edge_src[i]);
+    writeInt(n, graph.edge_dst[i]);
+  };
+
+  write_weights(n);
+  writeInt(n, graph.directed);
+
+  fclose(n);
+
+  return 1;
+}
 
 #endif
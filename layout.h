@@ -0,0 +1,461 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "graph.h"
+#include "parallel.h"
+#include <math.h>
+
+// Force-directed layout after Fruchterman and Reingold. Nodes repel
+// each other with k^2 / d, edges pull their ends together with d^2 / k,
+// where k is the ideal edge length, and a weak pull towards the centroid
+// keeps components from drifting apart. Each iteration moves a node by
+// at most the temperature, which cools until the layout settles.
+//
+// Repulsion is approximated with a Barnes-Hut quadtree: a cell seen
+// under an angle below theta acts as one body at its center of mass.
+// Every node first collects the bodies acting on it into a flat list,
+// then sums their forces in one tight loop over it.
+
+enum {
+  LAYOUT_MAX_DEPTH = 32,
+  LAYOUT_CHUNK = 64,
+  LAYOUT_ITERATIONS_PER_FRAME = 4,
+};
+
+// Bodies acting on one node, and the scratch of the worker finding them
+typedef struct {
+  i64 capacity;
+  i64 size;
+  f64 *x;
+  f64 *y;
+  f64 *mass;
+} Layout_Bodies;
+
+// Quadtree cells are stored as structure of arrays, the four children
+// of a cell next to each other from child. Leaves hold a list of points
+// linked through next_point, more than one only at the depth limit.
+typedef struct {
+  b8 active;
+  f64 edge_length;
+  f64 theta;
+  f64 gravity;
+  f64 cooling;
+  f64 temperature;
+  f64 min_temperature;
+  i64 pinned;
+  i64 iterations;
+
+  // Live nodes packed into points, with the point of every node slot.
+  // After a step the num_moved nodes it moved are packed to the front of
+  // point_node.
+  i64 points_capacity;
+  i64 num_points;
+  i64 num_moved;
+  i64 *point_node;
+  f64 *x;
+  f64 *y;
+  f64 *dx;
+  f64 *dy;
+  i64 *next_point;
+  i64 nodes_capacity;
+  i64 *node_point;
+
+  i64 cells_capacity;
+  i64 num_cells;
+  f64 *cell_cx;
+  f64 *cell_cy;
+  f64 *cell_half;
+  f64 *cell_mass;
+  f64 *cell_sx;
+  f64 *cell_sy;
+  i64 *cell_child;
+  i64 *cell_point;
+
+  Layout_Bodies bodies[MAX_WORKERS];
+} Layout;
+
+Layout layout = {
+    .edge_length = 300,
+    .theta = .8,
+    .gravity = .01,
+    .cooling = .98,
+    .min_temperature = 1,
+    .pinned = -1,
+};
+
+/************/
+/* QUADTREE */
+/************/
+
+i64 layout_add_cell(Layout *lt, f64 cx, f64 cy, f64 half) {
+  if (lt->num_cells == lt->cells_capacity) {
+    i64 old = lt->cells_capacity;
+    i64 cap = old > 0 ? old * 2 : 256;
+
+    lt->cell_cx = resize_array(lt->cell_cx, old, cap, sizeof(f64));
+    lt->cell_cy = resize_array(lt->cell_cy, old, cap, sizeof(f64));
+    lt->cell_half = resize_array(lt->cell_half, old, cap, sizeof(f64));
+    lt->cell_mass = resize_array(lt->cell_mass, old, cap, sizeof(f64));
+    lt->cell_sx = resize_array(lt->cell_sx, old, cap, sizeof(f64));
+    lt->cell_sy = resize_array(lt->cell_sy, old, cap, sizeof(f64));
+    lt->cell_child = resize_array(lt->cell_child, old, cap, sizeof(i64));
+    lt->cell_point = resize_array(lt->cell_point, old, cap, sizeof(i64));
+    lt->cells_capacity = cap;
+  }
+
+  i64 c = lt->num_cells++;
+
+  lt->cell_cx[c] = cx;
+  lt->cell_cy[c] = cy;
+  lt->cell_half[c] = half;
+  lt->cell_mass[c] = 0;
+  lt->cell_sx[c] = 0;
+  lt->cell_sy[c] = 0;
+  lt->cell_child[c] = -1;
+  lt->cell_point[c] = -1;
+
+  return c;
+}
+
+i64 layout_quadrant(Layout *lt, i64 cell, f64 x, f64 y) {
+  return (x >= lt->cell_cx[cell]) + 2 * (y >= lt->cell_cy[cell]);
+}
+
+void layout_split(Layout *lt, i64 cell) {
+  f64 h = lt->cell_half[cell] * .5;
+  f64 cx = lt->cell_cx[cell];
+  f64 cy = lt->cell_cy[cell];
+
+  // Children are added in quadrant order
+  i64 child = layout_add_cell(lt, cx - h, cy - h, h);
+  layout_add_cell(lt, cx + h, cy - h, h);
+  layout_add_cell(lt, cx - h, cy + h, h);
+  layout_add_cell(lt, cx + h, cy + h, h);
+  lt->cell_child[cell] = child;
+
+  // Push the point of the leaf down
+  i64 p = lt->cell_point[cell];
+  i64 c = child + layout_quadrant(lt, cell, lt->x[p], lt->y[p]);
+
+  lt->cell_point[cell] = -1;
+  lt->cell_point[c] = p;
+  lt->cell_mass[c] = 1;
+  lt->cell_sx[c] = lt->x[p];
+  lt->cell_sy[c] = lt->y[p];
+}
+
+void layout_insert(Layout *lt, i64 p) {
+  f64 x = lt->x[p];
+  f64 y = lt->y[p];
+  i64 c = 0;
+
+  for (i64 depth = 0;; ++depth) {
+    lt->cell_mass[c] += 1;
+    lt->cell_sx[c] += x;
+    lt->cell_sy[c] += y;
+
+    if (lt->cell_child[c] >= 0) {
+      c = lt->cell_child[c] + layout_quadrant(lt, c, x, y);
+      continue;
+    }
+
+    if (lt->cell_point[c] < 0 || depth == LAYOUT_MAX_DEPTH) {
+      lt->next_point[p] = lt->cell_point[c];
+      lt->cell_point[c] = p;
+      return;
+    }
+
+    layout_split(lt, c);
+    c = lt->cell_child[c] + layout_quadrant(lt, c, x, y);
+  }
+}
+
+void layout_build_tree(Layout *lt) {
+  f64 x0 = INFINITY;
+  f64 y0 = INFINITY;
+  f64 x1 = -INFINITY;
+  f64 y1 = -INFINITY;
+
+  for (i64 p = 0; p < lt->num_points; ++p) {
+    x0 = fmin(x0, lt->x[p]);
+    y0 = fmin(y0, lt->y[p]);
+    x1 = fmax(x1, lt->x[p]);
+    y1 = fmax(y1, lt->y[p]);
+  }
+
+  f64 half = fmax(fmax(x1 - x0, y1 - y0) * .5, 1) * 1.001;
+
+  lt->num_cells = 0;
+  layout_add_cell(lt, (x0 + x1) * .5, (y0 + y1) * .5, half);
+
+  for (i64 p = 0; p < lt->num_points; ++p)
+    layout_insert(lt, p);
+}
+
+/**********/
+/* FORCES */
+/**********/
+
+void layout_add_body(Layout_Bodies *bodies, f64 x, f64 y, f64 mass) {
+  if (bodies->size == bodies->capacity) {
+    i64 old = bodies->capacity;
+    i64 cap = old > 0 ? old * 2 : 256;
+
+    bodies->x = resize_array(bodies->x, old, cap, sizeof(f64));
+    bodies->y = resize_array(bodies->y, old, cap, sizeof(f64));
+    bodies->mass = resize_array(bodies->mass, old, cap, sizeof(f64));
+    bodies->capacity = cap;
+  }
+
+  bodies->x[bodies->size] = x;
+  bodies->y[bodies->size] = y;
+  bodies->mass[bodies->size] = mass;
+  bodies->size++;
+}
+
+// Walk the tree from the root, opening every cell that is too close to
+// act as one body.
+void layout_collect_bodies(Layout *lt, Layout_Bodies *bodies, i64 p) {
+  i64 stack[3 * LAYOUT_MAX_DEPTH + 4];
+  i64 size = 0;
+  f64 theta2 = lt->theta * lt->theta;
+
+  bodies->size = 0;
+  stack[size++] = 0;
+
+  while (size > 0) {
+    i64 c = stack[--size];
+    f64 mass = lt->cell_mass[c];
+    if (mass == 0)
+      continue;
+
+    if (lt->cell_child[c] < 0) {
+      for (i64 q = lt->cell_point[c]; q >= 0; q = lt->next_point[q])
+        if (q != p)
+          layout_add_body(bodies, lt->x[q], lt->y[q], 1);
+      continue;
+    }
+
+    f64 mx = lt->cell_sx[c] / mass;
+    f64 my = lt->cell_sy[c] / mass;
+    f64 dx = lt->x[p] - mx;
+    f64 dy = lt->y[p] - my;
+    f64 width = lt->cell_half[c] * 2;
+
+    if (width * width < theta2 * (dx * dx + dy * dy)) {
+      layout_add_body(bodies, mx, my, mass);
+    } else {
+      for (i64 k = 0; k < 4; ++k)
+        stack[size++] = lt->cell_child[c] + k;
+    }
+  }
+}
+
+// Sum of k^2 * mass / d along the direction away from every body, which
+// is k^2 * mass * (dx, dy) / d^2 and needs no square root. Bodies at the
+// same spot push nothing.
+void layout_repulsion(Layout_Bodies *bodies, f64 x, f64 y, f64 k2, f64 *fx,
+                      f64 *fy) {
+  f64 sum_x = 0;
+  f64 sum_y = 0;
+  i64 i = 0;
+
+#ifdef __SSE2__
+  __m128d px = _mm_set1_pd(x);
+  __m128d py = _mm_set1_pd(y);
+  __m128d zero = _mm_setzero_pd();
+  __m128d acc_x = zero;
+  __m128d acc_y = zero;
+
+  for (; i + 2 <= bodies->size; i += 2) {
+    __m128d dx = _mm_sub_pd(px, _mm_loadu_pd(&bodies->x[i]));
+    __m128d dy = _mm_sub_pd(py, _mm_loadu_pd(&bodies->y[i]));
+    __m128d d2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+
+    // Zero d2 gives zero force instead of a division by zero
+    __m128d apart = _mm_cmpgt_pd(d2, zero);
+    __m128d f = _mm_and_pd(
+        apart, _mm_div_pd(_mm_loadu_pd(&bodies->mass[i]),
+                          _mm_or_pd(d2, _mm_andnot_pd(apart, _mm_set1_pd(1)))));
+
+    acc_x = _mm_add_pd(acc_x, _mm_mul_pd(dx, f));
+    acc_y = _mm_add_pd(acc_y, _mm_mul_pd(dy, f));
+  }
+
+  f64 lanes[2];
+  _mm_storeu_pd(lanes, acc_x);
+  sum_x = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, acc_y);
+  sum_y = lanes[0] + lanes[1];
+#endif
+
+  for (; i < bodies->size; ++i) {
+    f64 dx = x - bodies->x[i];
+    f64 dy = y - bodies->y[i];
+    f64 d2 = dx * dx + dy * dy;
+
+    if (d2 > 0) {
+      sum_x += dx * bodies->mass[i] / d2;
+      sum_y += dy * bodies->mass[i] / d2;
+    }
+  }
+
+  *fx += sum_x * k2;
+  *fy += sum_y * k2;
+}
+
+void layout_repulsion_task(void *data, i64 worker, i64 begin, i64 end) {
+  Layout *lt = data;
+  Layout_Bodies *bodies = &lt->bodies[worker];
+  f64 k2 = lt->edge_length * lt->edge_length;
+
+  for (i64 p = begin; p < end; ++p) {
+    layout_collect_bodies(lt, bodies, p);
+    layout_repulsion(bodies, lt->x[p], lt->y[p], k2, &lt->dx[p], &lt->dy[p]);
+  }
+}
+
+/**********/
+/* LAYOUT */
+/**********/
+
+// Heat the layout up so it moves again, keeping it at least this hot.
+void layout_start(Layout *lt, f64 temperature) {
+  lt->active = 1;
+  if (lt->temperature < temperature)
+    lt->temperature = temperature;
+}
+
+void layout_gather(Graph *graph, Layout *lt) {
+  if (lt->points_capacity < graph->nodes_alive) {
+    i64 old = lt->points_capacity;
+    i64 cap = graph->nodes_alive;
+
+    lt->point_node = resize_array(lt->point_node, old, cap, sizeof(i64));
+    lt->x = resize_array(lt->x, old, cap, sizeof(f64));
+    lt->y = resize_array(lt->y, old, cap, sizeof(f64));
+    lt->dx = resize_array(lt->dx, old, cap, sizeof(f64));
+    lt->dy = resize_array(lt->dy, old, cap, sizeof(f64));
+    lt->next_point = resize_array(lt->next_point, old, cap, sizeof(i64));
+    lt->points_capacity = cap;
+  }
+
+  if (lt->nodes_capacity < graph->num_nodes) {
+    lt->node_point = resize_array(lt->node_point, lt->nodes_capacity,
+                                  graph->num_nodes, sizeof(i64));
+    lt->nodes_capacity = graph->num_nodes;
+  }
+
+  lt->num_points = 0;
+
+  for (i64 i = 0; i < graph->num_nodes; ++i) {
+    lt->node_point[i] = -1;
+    if (!bit_get(graph->node_enabled, i))
+      continue;
+
+    i64 p = lt->num_points++;
+    lt->point_node[p] = i;
+    lt->node_point[i] = p;
+    lt->x[p] = graph->node_x[i];
+    lt->y[p] = graph->node_y[i];
+  }
+}
+
+void layout_iterate(Graph *graph, Layout *lt, Worker_Pool *pool) {
+  i64 n = lt->num_points;
+  f64 cx = 0;
+  f64 cy = 0;
+
+  for (i64 p = 0; p < n; ++p) {
+    lt->dx[p] = 0;
+    lt->dy[p] = 0;
+    cx += lt->x[p];
+    cy += lt->y[p];
+  }
+
+  cx /= n;
+  cy /= n;
+
+  layout_build_tree(lt);
+  pool_run(pool, n, LAYOUT_CHUNK, layout_repulsion_task, lt);
+
+  // Attraction along the edges, d^2 / k along the edge
+  for (i64 i = 0; i < graph->num_edges; ++i) {
+    if (!adjacency_includes(graph, i))
+      continue;
+
+    i64 a = lt->node_point[graph->edge_src[i]];
+    i64 b = lt->node_point[graph->edge_dst[i]];
+    f64 dx = lt->x[b] - lt->x[a];
+    f64 dy = lt->y[b] - lt->y[a];
+    f64 f = sqrt(dx * dx + dy * dy) / lt->edge_length;
+
+    lt->dx[a] += dx * f;
+    lt->dy[a] += dy * f;
+    lt->dx[b] -= dx * f;
+    lt->dy[b] -= dy * f;
+  }
+
+  // Move every node by its force, capped by the temperature
+  for (i64 p = 0; p < n; ++p) {
+    if (lt->point_node[p] == lt->pinned)
+      continue;
+
+    f64 dx = lt->dx[p] - (lt->x[p] - cx) * lt->gravity * lt->edge_length;
+    f64 dy = lt->dy[p] - (lt->y[p] - cy) * lt->gravity * lt->edge_length;
+    f64 d = sqrt(dx * dx + dy * dy);
+
+    if (d > lt->temperature) {
+      dx *= lt->temperature / d;
+      dy *= lt->temperature / d;
+    }
+
+    lt->x[p] += dx;
+    lt->y[p] += dy;
+  }
+
+  lt->temperature *= lt->cooling;
+  lt->iterations++;
+}
+
+// Run a few iterations on the packed positions, then move the nodes
+// that moved, through move_nodes on the global graph. Stops the layout
+// once it has cooled down.
+void layout_step(Graph *graph, Layout *lt, Worker_Pool *pool,
+                 i64 iterations) {
+  lt->num_moved = 0;
+  if (!lt->active)
+    return;
+
+  layout_gather(graph, lt);
+
+  if (lt->num_points == 0) {
+    lt->active = 0;
+    return;
+  }
+
+  for (i64 i = 0; i < iterations; ++i)
+    layout_iterate(graph, lt, pool);
+
+  // Pack the nodes that moved to the front, the pinned one never does
+  for (i64 p = 0; p < lt->num_points; ++p) {
+    i64 node = lt->point_node[p];
+
+    if (lt->x[p] != graph->node_x[node] || lt->y[p] != graph->node_y[node]) {
+      lt->point_node[lt->num_moved] = node;
+      lt->x[lt->num_moved] = lt->x[p];
+      lt->y[lt->num_moved] = lt->y[p];
+      lt->num_moved++;
+    }
+  }
+
+  if (lt->num_moved > 0)
+    move_nodes(lt->num_moved, lt->point_node, lt->x, lt->y);
+
+  if (lt->temperature < lt->min_temperature) {
+    lt->temperature = 0;
+    lt->active = 0;
+  }
+}
+
+#endif
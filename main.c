@@ -2,48 +2,197 @@
 #include "lib/graphics.c"
 #include <stdio.h>
 #include "algorithms.h"
+#include "layout.h"
+
+// Blue through purple to red. The square root spreads out the low end,
+// where most nodes of a skewed distribution sit.
+u32 heat_color(f64 t) {
+  if (t < 0)
+    t = 0;
+  if (t > 1)
+    t = 1;
+  t = sqrt(t);
+
+  u32 r = (u32)(64 + 191 * t);
+  u32 g = 64;
+  u32 b = (u32)(224 - 160 * t);
+
+  return (r << 16) | (g << 8) | b;
+}
+
+// Distinct colors for labels, stepping the hue by the golden ratio so
+// neighboring labels differ most. Kept mid-bright to read on white.
+u32 label_color(i64 label) {
+  f64 h = fmod(label * 0.618033988749895, 1) * 6;
+  f64 x = 1 - fabs(fmod(h, 2) - 1);
+  f64 rgb[6][3] = {{1, x, 0}, {x, 1, 0}, {0, 1, x},
+                   {0, x, 1}, {x, 0, 1}, {1, 0, x}};
+  f64 *c = rgb[(i64)h];
+
+  u32 r = (u32)(40 + 180 * c[0]);
+  u32 g = (u32)(40 + 180 * c[1]);
+  u32 b = (u32)(40 + 180 * c[2]);
+
+  return (r << 16) | (g << 8) | b;
+}
+
+// Colors of the node and edge slots handed to draw_graph, refilled
+// before each draw
+u32 *node_colors = NULL;
+u32 *edge_colors = NULL;
+i64 node_colors_capacity = 0;
+i64 edge_colors_capacity = 0;
+
+void reserve_colors(void) {
+  if (node_colors_capacity < graph.num_nodes) {
+    node_colors = resize_array(node_colors, 0, graph.num_nodes, sizeof(u32));
+    node_colors_capacity = graph.num_nodes;
+  }
+
+  if (edge_colors_capacity < graph.num_edges) {
+    edge_colors = resize_array(edge_colors, 0, graph.num_edges, sizeof(u32));
+    edge_colors_capacity = graph.num_edges;
+  }
+}
+
+u32 *heat_colors(f64 *heat, f64 max_heat) {
+  reserve_colors();
+
+  for (i64 i = 0; i < graph.num_nodes; ++i)
+    node_colors[i] = max_heat > 0 ? heat_color(heat[i] / max_heat) : 0x7f7f7f;
+
+  return node_colors;
+}
+
+// Nodes and edges of every strong component with more than one node in
+// the color of its label. Single nodes and edges between components stay
+// grey.
+void component_colors(Strong_Components *scc) {
+  reserve_colors();
+
+  for (i64 i = 0; i < graph.num_nodes; ++i) {
+    i64 c = scc->component[i];
+    node_colors[i] = c >= 0 && scc->size[c] > 1 ? label_color(c) : 0x7f7f7f;
+  }
+
+  for (i64 i = 0; i < graph.num_edges; ++i) {
+    i64 c = scc->component[graph.edge_src[i]];
+    b8 inside = c >= 0 && c == scc->component[graph.edge_dst[i]];
+    edge_colors[i] = inside ? node_colors[graph.edge_src[i]] : 0x7f7f7f;
+  }
+}
+
+// Edges of every path in the color of its number, the first path on top
+// where they share edges. Other edges keep their color in base, or grey
+// if it is NULL.
+u32 *path_colors(u32 *base) {
+  reserve_colors();
+
+  if (base == NULL)
+    for (i64 i = 0; i < graph.num_edges; ++i)
+      edge_colors[i] = 0x7f7f7f;
+
+  for (i64 p = graph.num_paths - 1; p >= 0; --p)
+    for (i64 k = graph.path_offsets[p]; k < graph.path_offsets[p + 1]; ++k)
+      edge_colors[graph.path[k]] = label_color(p);
 
-void draw_graph(void) {
-  for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-    Edge e = graph.edges[i];
-    Node n0 = graph.nodes[e.src];
-    Node n1 = graph.nodes[e.dst];
+  return edge_colors;
+}
+
+// Arrowhead of a directed edge, with its tip on the rim of the dst node.
+void draw_arrowhead(u32 color, i64 edge_idx) {
+  i64 src = graph.edge_src[edge_idx];
+  i64 dst = graph.edge_dst[edge_idx];
+  f64 dx = graph.node_x[dst] - graph.node_x[src];
+  f64 dy = graph.node_y[dst] - graph.node_y[src];
+  f64 len = sqrt(dx * dx + dy * dy);
+
+  if (len <= graph.node_radius[dst])
+    return;
+
+  dx /= len;
+  dy /= len;
+
+  f64 w = graph.edge_width[edge_idx];
+  f64 tip_x = graph.node_x[dst] - dx * graph.node_radius[dst];
+  f64 tip_y = graph.node_y[dst] - dy * graph.node_radius[dst];
+  f64 base_x = tip_x - dx * w * 1.5;
+  f64 base_y = tip_y - dy * w * 1.5;
+
+  fill_triangle(OP_SET, color, tip_x, tip_y, base_x - dy * w, base_y + dx * w,
+                base_x + dy * w, base_y - dx * w);
+}
+
+// Nodes and edges are drawn in the given colors of their slots when the
+// arrays are not NULL, grey otherwise. Highlight and hover win over both.
+void draw_graph(u32 *node_color, u32 *edge_color) {
+  for (i64 i = 0; i < graph.num_edges; ++i) {
+    i64 src = graph.edge_src[i];
+    i64 dst = graph.edge_dst[i];
 
     u32 color = 0x7f7f7f; // grey color
 
-    if (e.highlight)
+    if (edge_color != NULL)
+      color = edge_color[i];
+    if (bit_get(graph.edge_highlight, i))
       color = 0xff00ff; // pink color
-    if (e.hover)
+    if (bit_get(graph.edge_hover, i))
       color = 0x007f00; // green color
 
     // FIXME: color of line on node
-    if (e.enabled)
-      fill_line(OP_SET, color, n0.x, n0.y, n1.x, n1.y, e.width);
+    if (!bit_get(graph.edge_enabled, i))
+      continue;
+
+    fill_line(OP_SET, color, graph.node_x[src], graph.node_y[src],
+              graph.node_x[dst], graph.node_y[dst], graph.edge_width[i]);
+
+    if (graph.directed)
+      draw_arrowhead(color, i);
   }
 
-  for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-    Node n = graph.nodes[i];
+  for (i64 i = 0; i < graph.num_nodes; ++i) {
+    f64 r = graph.node_radius[i];
     u32 color = 0x7f7f7f; // grey color
 
-    if (n.highlight)
+    if (node_color != NULL)
+      color = node_color[i];
+    if (bit_get(graph.node_highlight, i))
       color = 0xfff0ff; // no name color
-    if (n.hover)
+    if (bit_get(graph.node_hover, i))
       color = 0x007f00; // green color
 
-    if (n.enabled)
-      fill_ellipse(OP_SET, color, n.x - n.radius, n.y - n.radius, n.radius * 2,
-                   n.radius * 2);
+    if (bit_get(graph.node_enabled, i))
+      fill_ellipse(OP_SET, color, graph.node_x[i] - r, graph.node_y[i] - r,
+                   r * 2, r * 2);
   }
 }
 
-i32 readInt(FILE *f) {
-  i32 x;
-  fscanf(f, "%d", &x);
-
-  return x;
+// Whether data computed at the versions can still be shown. While the
+// layout moves every node each frame, expensive data lagging behind
+// only in geometry is kept until the layout settles, since recomputing
+// it on every frame would stall the animation. Cheap data follows the
+// nodes on every frame.
+b8 up_to_date(b8 expensive, u64 topology_version, u64 geometry_version) {
+  return topology_version == graph.topology_version &&
+         ((expensive && layout.active) ||
+          geometry_version == graph.geometry_version);
 }
 
-void writeInt(FILE *f, i32 value) { fprintf(f, "%d ", value); }
+// The mode a path query runs in. While the layout moves, a hierarchy or
+// landmarks no longer current would be rebuilt for every query and every
+// frame, so queries fall back to Dijkstra until the layout settles.
+i64 path_engine(i64 mode) {
+  if (!layout.active)
+    return mode;
+
+  if (mode == PATH_CONTRACTION &&
+      !contraction_hierarchy_is_current(&graph, &contraction_hierarchy))
+    return PATH_DIJKSTRA;
+  if (mode == PATH_LANDMARKS && !landmarks_are_current(&graph, &landmarks))
+    return PATH_DIJKSTRA;
+
+  return mode;
+}
 
 i32 main() {
   platform = (Platform){
@@ -58,121 +207,102 @@ i32 main() {
   i64 adding_src = 0;
   i64 adding_dst = 0;
 
-  b8 path_changed = 0;
   i64 path_src = -1;
   i64 path_dst = -1;
+  i64 path_mode = PATH_INCREMENTAL;
+  b8 show_forest = 0;
+  b8 show_flow = 0;
+  b8 show_betweenness = 0;
+  b8 show_page_rank = 0;
+  b8 show_components = 0;
 
   b8 dragging = 0;
   i64 drag_node_index = -1;
   f64 drag_x0 = 0;
   f64 drag_y0 = 0;
+  f64 drag_node_x0 = 0;
+  f64 drag_node_y0 = 0;
 
   f64 offset_x = 0;
   f64 offset_y = 0;
 
-  {
-    FILE *n = fopen("coords-write.txt", "rb");
-
-    i32 num_nodes = readInt(n);
-
-    for (i64 i = 0; i < num_nodes; ++i) {
-      f64 x = readInt(n);
-      f64 y = readInt(n);
-
-      add_node(x, y);
-    };
+  // What the frame on screen was drawn from
+  b8 drawn = 0;
+  b8 drawn_adding_edge = 0;
+  u64 drawn_topology_version = 0;
+  u64 drawn_geometry_version = 0;
+  i64 drawn_hover_node = -1;
+  i64 drawn_hover_edge = -1;
+  i32 drawn_width = 0;
+  i32 drawn_height = 0;
 
-    i32 num_edges = readInt(n);
-
-    for (i64 i = 0; i < num_edges; ++i) {
-      i32 src = readInt(n);
-      i32 dst = readInt(n);
-
-      add_edge(src, dst);
-    };
-
-    fclose(n);
+  {
+    load_graph("coords-write.txt");
+    load_contraction_hierarchy(&graph, &contraction_hierarchy,
+                               "coords-write.ch");
   }
 
   while (!platform.done) {
-    p_wait_events();
-
-    b8 hover_node = 0;
-
-    fill_rectangle(OP_SET, 0xffffff, 0, 0, platform.frame_width,
-                   platform.frame_height);
-
-    if (platform.key_pressed[BUTTON_RIGHT])
-      for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-        if (graph.nodes[i].enabled && graph.nodes[i].hover) {
-          adding_edge = 1;
-          adding_src = i;
-          adding_dst = i;
-          break;
-        }
-      }
+    // Keep the frames coming while the layout is moving
+    if (layout.active)
+      p_handle_events();
+    else
+      p_wait_events();
+
+    if (platform.key_pressed[BUTTON_RIGHT] && graph.hover_node >= 0) {
+      adding_edge = 1;
+      adding_src = graph.hover_node;
+      adding_dst = graph.hover_node;
+    }
 
     if (platform.key_pressed[BUTTON_LEFT]) {
       f64 x = platform.cursor_x;
       f64 y = platform.cursor_y;
       b8 node_found = 0;
 
-      for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-        if (graph.nodes[i].enabled && graph.nodes[i].hover) {
-          drag_node_index = i;
-          dragging = 1;
-          node_found = 1;
+      if (graph.hover_node >= 0) {
+        i64 i = graph.hover_node;
 
-          drag_x0 = platform.cursor_x;
-          drag_y0 = platform.cursor_y;
+        drag_node_index = i;
+        dragging = 1;
+        node_found = 1;
 
-          for (i64 j = 0; j < MAX_NUM_NODES; ++j) {
-            graph.nodes[j].drag_x = graph.nodes[j].x;
-            graph.nodes[j].drag_y = graph.nodes[j].y;
-          }
+        drag_x0 = platform.cursor_x;
+        drag_y0 = platform.cursor_y;
+        drag_node_x0 = graph.node_x[i];
+        drag_node_y0 = graph.node_y[i];
 
-          /* offset_x = nodes[i].x - platform.cursor_x; */
-          /* offset_y = nodes[i].y - platform.cursor_y; */
-        }
+        /* offset_x = nodes[i].x - platform.cursor_x; */
+        /* offset_y = nodes[i].y - platform.cursor_y; */
       }
 
       if (!node_found)
         add_node(x, y);
-      path_changed = 1;
     }
 
     if (!platform.key_down[BUTTON_LEFT]) {
       dragging = 0;
-      path_changed = 1;
       drag_node_index = -1;
+      layout.pinned = -1;
     }
 
+    // The dragged node is pinned to the cursor and the layout pulls the
+    // rest after it
     if (dragging) {
       f64 dx = platform.cursor_x - drag_x0;
       f64 dy = platform.cursor_y - drag_y0;
 
-      graph.nodes[drag_node_index].x = graph.nodes[drag_node_index].drag_x + dx;
-      graph.nodes[drag_node_index].y = graph.nodes[drag_node_index].drag_y + dy;
-
-      for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-        b8 is_neighbor = 0;
-
-        if (i == drag_node_index)
-          continue;
+      if (graph.node_x[drag_node_index] != drag_node_x0 + dx ||
+          graph.node_y[drag_node_index] != drag_node_y0 + dy) {
+        u64 geometry_version = graph.geometry_version;
+        move_node(drag_node_index, drag_node_x0 + dx, drag_node_y0 + dy);
 
-        for (i64 j = 0; j < MAX_NUM_EDGES; ++j) {
-          Edge e = graph.edges[j];
-          if ((e.src == drag_node_index && e.dst == i) ||
-              (e.src == i && e.dst == drag_node_index)) {
-            is_neighbor = 1;
-            break;
-          }
-        }
+        if (path_mode == PATH_INCREMENTAL)
+          repair_path_tree(&graph, &path_tree, &drag_node_index, 1,
+                           geometry_version);
 
-        if (is_neighbor) {
-          graph.nodes[i].x = graph.nodes[i].drag_x + dx * .4;
-          graph.nodes[i].y = graph.nodes[i].drag_y + dy * .4;
-        }
+        layout.pinned = drag_node_index;
+        layout_start(&layout, layout.edge_length * .25);
       }
 
       /* if (!overlap) { */
@@ -181,111 +311,221 @@ i32 main() {
       /* } */
     }
 
+    if (platform.key_pressed['l']) {
+      if (layout.active)
+        layout.active = 0;
+      else
+        layout_start(&layout, layout.edge_length);
+    }
+
+    // The incremental path tree follows the nodes the layout moved
+    u64 geometry_version = graph.geometry_version;
+    layout_step(&graph, &layout, &worker_pool, LAYOUT_ITERATIONS_PER_FRAME);
+
+    if (path_mode == PATH_INCREMENTAL)
+      repair_path_tree(&graph, &path_tree, layout.point_node,
+                       layout.num_moved, geometry_version);
+
     if (platform.key_pressed[KEY_DELETE]) {
       remove_node();
       remove_edge();
     }
 
-    for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-      if (graph.nodes[i].enabled) {
-        update_node(i);
-        if (graph.nodes[i].hover)
-          hover_node = 1;
-      }
+    update_node_hover();
+    update_edge_hover();
+
+    if (platform.key_pressed[BUTTON_RIGHT] && graph.hover_node >= 0) {
+      adding_edge = 1;
+      adding_src = graph.hover_node;
+      adding_dst = graph.hover_node;
     }
 
-    for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-      if (hover_node) {
-        graph.edges[i].hover = 0;
-      } else {
-        update_edge(i);
-      }
+    if (adding_edge && graph.hover_node >= 0)
+      adding_dst = graph.hover_node;
+
+    if (adding_edge && !platform.key_down[BUTTON_RIGHT]) {
+      adding_edge = 0;
+      add_edge(adding_src, adding_dst);
     }
 
-    if (platform.key_pressed[BUTTON_RIGHT])
-      for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-        if (graph.nodes[i].enabled && graph.nodes[i].hover) {
-          adding_edge = 1;
-          adding_src = i;
-          adding_dst = i;
-          break;
-        }
-      }
+    // Finding shortest path //
+    if (platform.key_pressed['1'] && graph.hover_node >= 0)
+      path_src = graph.hover_node;
+
+    if (platform.key_pressed['2'] && graph.hover_node >= 0)
+      path_dst = graph.hover_node;
 
-    if (adding_edge) {
-      f64 x0 = graph.nodes[adding_src].x;
-      f64 y0 = graph.nodes[adding_src].y;
-      f64 x1 = platform.cursor_x;
-      f64 y1 = platform.cursor_y;
+    if (platform.key_pressed['m'])
+      path_mode = (path_mode + 1) % NUM_PATH_MODES;
 
-      fill_line(OP_SET, 0x7f007f, x0, y0, x1, y1, 30);
+    // Edge weights //
+    if (platform.key_pressed['w']) {
+      set_weighted(&graph, !graph.weighted);
+      printf("%s\n", graph.weighted ? "Weighted edges" : "Geometric edges");
     }
 
-    if (adding_edge)
-      for (i64 i = 0; i < MAX_NUM_NODES; ++i)
-        if (graph.nodes[i].enabled && graph.nodes[i].hover) {
-          adding_dst = i;
-          break;
-        }
+    if (platform.key_pressed['q']) {
+      quantize_edge_weights(&graph, !graph.weights_quantized, 0);
+      printf("%s weights\n", graph.weights_quantized ? "Quantized" : "f32");
+    }
 
-    if (adding_edge && !platform.key_down[BUTTON_RIGHT]) {
-      adding_edge = 0;
-      add_edge(adding_src, adding_dst);
+    if (graph.hover_edge >= 0 &&
+        (platform.key_pressed['='] || platform.key_pressed['-'])) {
+      f64 weight = get_edge_weight(&graph, graph.hover_edge);
+      weight *= platform.key_pressed['='] ? 2 : .5;
+
+      set_edge_weight(&graph, graph.hover_edge, weight);
+      printf("Edge weight %g\n", get_edge_weight(&graph, graph.hover_edge));
     }
 
-    // Finding shortest path //
-    if (platform.key_pressed['1']) {
-      for (i64 i = 0; i < MAX_NUM_NODES; ++i)
-        if (graph.nodes[i].enabled && graph.nodes[i].hover) {
-          path_src = i;
-          path_changed = 1;
-          break;
-        }
+    // Spanning forest, shown in place of the path //
+    b8 forest_toggled = platform.key_pressed['t'];
+    if (forest_toggled)
+      show_forest = !show_forest;
+
+    // Minimum cut between the path nodes, shown in place of the path //
+    b8 flow_toggled = platform.key_pressed['f'];
+    if (flow_toggled)
+      show_flow = !show_flow;
+
+    b8 path_changed = 0;
+
+    if (show_forest) {
+      path_changed = forest_toggled ||
+                     !up_to_date(0, spanning_forest.topology_version,
+                                 spanning_forest.geometry_version);
+      if (path_changed)
+        highlight_spanning_forest(&graph, &spanning_forest, &worker_pool);
+    } else if (show_flow) {
+      path_changed = forest_toggled || flow_toggled ||
+                     max_flow.src != path_src || max_flow.dst != path_dst ||
+                     max_flow.directed != graph.directed ||
+                     !up_to_date(1, max_flow.topology_version,
+                                 max_flow.geometry_version);
+      if (path_changed)
+        highlight_max_flow(&graph, &max_flow, path_src, path_dst);
+    } else {
+      i64 engine = path_engine(path_mode);
+
+      // Yen's k paths take far longer than a single search
+      path_changed = graph.path_src != path_src ||
+                     graph.path_dst != path_dst ||
+                     graph.path_mode != engine ||
+                     !up_to_date(engine == PATH_K_SHORTEST,
+                                 graph.path_topology_version,
+                                 graph.path_geometry_version);
+      if (path_changed)
+        highlight_path(&graph, path_src, path_dst, engine);
     }
 
-    if (platform.key_pressed['2'])
-      for (i64 i = 0; i < MAX_NUM_NODES; ++i)
-        if (graph.nodes[i].enabled && graph.nodes[i].hover) {
-          path_dst = i;
-          path_changed = 1;
-          break;
-        }
-
-    if (path_changed) {
-      highlight_path(&graph, path_src, path_dst);
-      path_changed = 0; // FIXME: if enabled, highlight isn't showing
+    // Betweenness or PageRank heat map //
+    b8 heat_changed = platform.key_pressed['b'] || platform.key_pressed['r'];
+    if (platform.key_pressed['b']) {
+      show_betweenness = !show_betweenness;
+      show_page_rank = 0;
+    }
+    if (platform.key_pressed['r']) {
+      show_page_rank = !show_page_rank;
+      show_betweenness = 0;
     }
 
-    draw_graph();
+    if (show_betweenness && !up_to_date(1, betweenness.topology_version,
+                                        betweenness.geometry_version)) {
+      update_betweenness(&graph, &betweenness, &worker_pool);
+      heat_changed = 1;
+    }
 
-    p_render_frame();
-  }
+    if (show_page_rank && !page_rank_is_current(&graph, &page_rank)) {
+      find_page_rank(&graph, &page_rank, &worker_pool);
+      printf("PageRank, %lld iterations, residual %g\n",
+             page_rank.num_iterations, page_rank.residual);
+      heat_changed = 1;
+    }
 
-  p_cleanup();
+    // Directed mode and its strong components //
+    if (platform.key_pressed['d']) {
+      graph.directed = !graph.directed;
+      printf("%s edges\n", graph.directed ? "Directed" : "Undirected");
+      heat_changed = 1;
+    }
 
-  {
-    FILE *n = fopen("coords-write.txt", "wb");
+    if (platform.key_pressed['c']) {
+      show_components = !show_components;
+      heat_changed = 1;
+    }
 
-    writeInt(n, nodes_count());
+    b8 color_components = show_components && graph.directed &&
+                          !show_betweenness && !show_page_rank;
+
+    if (color_components &&
+        !strong_components_are_current(&graph, &strong_components)) {
+      find_strong_components(&graph, &strong_components);
+      printf("%lld strong components, %lld with more than one node, the "
+             "largest has %lld\n",
+             strong_components.num_components,
+             strong_components.num_nontrivial, strong_components.largest);
+      heat_changed = 1;
+    }
 
-    for (i64 i = 0; i < MAX_NUM_NODES; ++i) {
-      if (graph.nodes[i].enabled) {
-        writeInt(n, (i32)graph.nodes[i].x);
-        writeInt(n, (i32)graph.nodes[i].y);
+    // Redraw only if something visible changed since the last frame
+    b8 redraw = !drawn || path_changed || heat_changed || adding_edge ||
+                drawn_adding_edge ||
+                drawn_topology_version != graph.topology_version ||
+                drawn_geometry_version != graph.geometry_version ||
+                drawn_hover_node != graph.hover_node ||
+                drawn_hover_edge != graph.hover_edge ||
+                drawn_width != platform.frame_width ||
+                drawn_height != platform.frame_height;
+
+    if (redraw) {
+      fill_rectangle(OP_SET, 0xffffff, 0, 0, platform.frame_width,
+                     platform.frame_height);
+
+      if (adding_edge) {
+        f64 x0 = graph.node_x[adding_src];
+        f64 y0 = graph.node_y[adding_src];
+        f64 x1 = platform.cursor_x;
+        f64 y1 = platform.cursor_y;
+
+        fill_line(OP_SET, 0x7f007f, x0, y0, x1, y1, 30);
       }
-    };
-
-    writeInt(n, edges_count());
 
-    for (i64 i = 0; i < MAX_NUM_EDGES; ++i) {
-      if (graph.edges[i].enabled) {
-        writeInt(n, graph.edges[i].src);
-        writeInt(n, graph.edges[i].dst);
+      u32 *node_color = NULL;
+      u32 *edge_color = NULL;
+
+      if (show_betweenness) {
+        node_color =
+            heat_colors(betweenness.centrality, betweenness.max_centrality);
+      } else if (show_page_rank) {
+        node_color = heat_colors(page_rank.node_rank, page_rank.max_rank);
+      } else if (color_components) {
+        component_colors(&strong_components);
+        node_color = node_colors;
+        edge_color = edge_colors;
       }
-    };
 
-    fclose(n);
+      if (graph.path_mode == PATH_K_SHORTEST && graph.num_paths > 0)
+        edge_color = path_colors(edge_color);
+
+      draw_graph(node_color, edge_color);
+
+      drawn = 1;
+      drawn_adding_edge = adding_edge;
+      drawn_topology_version = graph.topology_version;
+      drawn_geometry_version = graph.geometry_version;
+      drawn_hover_node = graph.hover_node;
+      drawn_hover_edge = graph.hover_edge;
+      drawn_width = platform.frame_width;
+      drawn_height = platform.frame_height;
+    }
+
+    p_render_frame();
   }
 
+  p_cleanup();
+
+  save_graph_and_hierarchy(&contraction_hierarchy, "coords-write.txt",
+                           "coords-write.ch");
+
   return 0;
 }
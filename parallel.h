@@ -0,0 +1,167 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "lib/graphics.c"
+#include <pthread.h>
+#include <unistd.h>
+
+enum {
+  MAX_WORKERS = 64,
+};
+
+// Pool of threads that split the items of a task between them. The
+// calling thread takes part as worker 0. Items are handed out in chunks
+// from a shared counter, so uneven items balance out.
+//
+// The task gets the index of the worker running it, in [0, num_workers),
+// to pick its own scratch, and must not write anything shared with the
+// other workers except through its own items.
+typedef void Pool_Task(void *data, i64 worker, i64 begin, i64 end);
+
+typedef struct Worker_Pool Worker_Pool;
+
+typedef struct {
+  Worker_Pool *pool;
+  i64 index;
+  pthread_t thread;
+} Pool_Worker;
+
+struct Worker_Pool {
+  i64 num_workers;
+  Pool_Worker workers[MAX_WORKERS];
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  u64 generation;
+  i64 num_running;
+
+  Pool_Task *task;
+  void *data;
+  i64 num_items;
+  i64 chunk_size;
+  i64 next_item;
+};
+
+Worker_Pool worker_pool = {0};
+
+f64 atomic_load_f64(f64 *p) {
+  f64 value;
+  __atomic_load(p, &value, __ATOMIC_RELAXED);
+  return value;
+}
+
+// Lower the value at p if the new one is smaller, returns whether it did.
+b8 atomic_min_f64(f64 *p, f64 value) {
+  f64 old = atomic_load_f64(p);
+
+  while (value < old)
+    if (__atomic_compare_exchange(p, &old, &value, 1, __ATOMIC_RELAXED,
+                                  __ATOMIC_RELAXED))
+      return 1;
+
+  return 0;
+}
+
+void pool_work(Worker_Pool *pool, i64 worker) {
+  for (;;) {
+    i64 begin = __atomic_fetch_add(&pool->next_item, pool->chunk_size,
+                                   __ATOMIC_RELAXED);
+    if (begin >= pool->num_items)
+      break;
+
+    i64 end = begin + pool->chunk_size;
+    if (end > pool->num_items)
+      end = pool->num_items;
+
+    pool->task(pool->data, worker, begin, end);
+  }
+}
+
+void *pool_worker_main(void *arg) {
+  Pool_Worker *worker = arg;
+  Worker_Pool *pool = worker->pool;
+  u64 generation = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  for (;;) {
+    while (pool->generation == generation)
+      pthread_cond_wait(&pool->wake, &pool->mutex);
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_work(pool, worker->index);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->num_running == 0)
+      pthread_cond_signal(&pool->done);
+  }
+
+  return NULL;
+}
+
+// Start the threads, one per online core if num_workers is 0. The
+// threads live as long as the program.
+void pool_start(Worker_Pool *pool, i64 num_workers) {
+  assert(pool->num_workers == 0);
+
+  if (num_workers <= 0)
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_workers < 1)
+    num_workers = 1;
+  if (num_workers > MAX_WORKERS)
+    num_workers = MAX_WORKERS;
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->num_workers = num_workers;
+
+  for (i64 i = 1; i < num_workers; ++i) {
+    Pool_Worker *worker = &pool->workers[i];
+    worker->pool = pool;
+    worker->index = i;
+
+    i32 status =
+        pthread_create(&worker->thread, NULL, pool_worker_main, worker);
+    assert(status == 0);
+  }
+}
+
+// Run the task over [0, num_items) and wait until every item is done.
+// Starts the pool on first use. Tasks must not run the pool themselves.
+void pool_run(Worker_Pool *pool, i64 num_items, i64 chunk_size,
+              Pool_Task *task, void *data) {
+  if (pool->num_workers == 0)
+    pool_start(pool, 0);
+  if (chunk_size < 1)
+    chunk_size = 1;
+
+  if (pool->num_workers == 1 || num_items <= chunk_size) {
+    if (num_items > 0)
+      task(data, 0, 0, num_items);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  assert(pool->num_running == 0);
+  pool->task = task;
+  pool->data = data;
+  pool->num_items = num_items;
+  pool->chunk_size = chunk_size;
+  pool->next_item = 0;
+  pool->num_running = pool->num_workers - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+
+  pool_work(pool, 0);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->num_running > 0)
+    pthread_cond_wait(&pool->done, &pool->mutex);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+#endif
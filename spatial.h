@@ -0,0 +1,223 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include "lib/graphics.c"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Uniform grid over the plane with cells of cell_size by cell_size.
+// Only non-empty cells are stored, in an open addressing hash table keyed
+// by cell coordinates. An item covering several cells is listed in each
+// of them.
+
+typedef struct {
+  b8 used;
+  i64 cx;
+  i64 cy;
+  i64 size;
+  i64 capacity;
+  i64 *items;
+} Grid_Cell;
+
+typedef struct {
+  f64 cell_size;
+  i64 num_cells;
+  i64 table_size;
+  Grid_Cell *cells;
+} Grid;
+
+i64 grid_coord(Grid *grid, f64 v) { return (i64)floor(v / grid->cell_size); }
+
+u64 grid_hash(i64 cx, i64 cy) {
+  u64 h = (u64)cx * 0x9e3779b97f4a7c15ull ^ (u64)cy * 0xc2b2ae3d27d4eb4full;
+  return h ^ (h >> 29);
+}
+
+Grid_Cell *grid_lookup(Grid *grid, i64 cx, i64 cy) {
+  if (grid->table_size == 0)
+    return NULL;
+
+  u64 mask = grid->table_size - 1;
+
+  for (u64 i = grid_hash(cx, cy) & mask;; i = (i + 1) & mask) {
+    Grid_Cell *cell = &grid->cells[i];
+
+    if (!cell->used)
+      return NULL;
+    if (cell->cx == cx && cell->cy == cy)
+      return cell;
+  }
+}
+
+void grid_rehash(Grid *grid, i64 table_size) {
+  Grid_Cell *old = grid->cells;
+  i64 old_size = grid->table_size;
+
+  grid->cells = calloc(table_size, sizeof(Grid_Cell));
+  assert(grid->cells != NULL);
+  grid->table_size = table_size;
+
+  u64 mask = table_size - 1;
+
+  for (i64 j = 0; j < old_size; ++j) {
+    if (!old[j].used)
+      continue;
+
+    u64 i = grid_hash(old[j].cx, old[j].cy) & mask;
+    while (grid->cells[i].used)
+      i = (i + 1) & mask;
+
+    grid->cells[i] = old[j];
+  }
+
+  free(old);
+}
+
+// Find the cell, adding an empty one if it is not in the table yet.
+// Cells are never removed, an emptied cell keeps its storage for reuse.
+Grid_Cell *grid_cell(Grid *grid, i64 cx, i64 cy) {
+  Grid_Cell *cell = grid_lookup(grid, cx, cy);
+  if (cell != NULL)
+    return cell;
+
+  if ((grid->num_cells + 1) * 2 > grid->table_size)
+    grid_rehash(grid, grid->table_size > 0 ? grid->table_size * 2 : 64);
+
+  u64 mask = grid->table_size - 1;
+  u64 i = grid_hash(cx, cy) & mask;
+  while (grid->cells[i].used)
+    i = (i + 1) & mask;
+
+  cell = &grid->cells[i];
+  cell->used = 1;
+  cell->cx = cx;
+  cell->cy = cy;
+  grid->num_cells++;
+
+  return cell;
+}
+
+void grid_cell_add(Grid_Cell *cell, i64 item) {
+  if (cell->size == cell->capacity) {
+    i64 capacity = cell->capacity > 0 ? cell->capacity * 2 : 4;
+    cell->items = realloc(cell->items, capacity * sizeof(i64));
+    assert(cell->items != NULL);
+    cell->capacity = capacity;
+  }
+
+  cell->items[cell->size++] = item;
+}
+
+void grid_cell_remove(Grid_Cell *cell, i64 item) {
+  for (i64 i = 0; i < cell->size; ++i)
+    if (cell->items[i] == item) {
+      cell->items[i] = cell->items[--cell->size];
+      return;
+    }
+}
+
+// Add the item to every cell overlapping the box.
+void grid_insert(Grid *grid, i64 item, f64 x0, f64 y0, f64 x1, f64 y1) {
+  i64 cx1 = grid_coord(grid, x1);
+  i64 cy1 = grid_coord(grid, y1);
+
+  for (i64 cy = grid_coord(grid, y0); cy <= cy1; ++cy)
+    for (i64 cx = grid_coord(grid, x0); cx <= cx1; ++cx)
+      grid_cell_add(grid_cell(grid, cx, cy), item);
+}
+
+// Remove the item from every cell overlapping the box it was inserted with.
+void grid_remove(Grid *grid, i64 item, f64 x0, f64 y0, f64 x1, f64 y1) {
+  i64 cx1 = grid_coord(grid, x1);
+  i64 cy1 = grid_coord(grid, y1);
+
+  for (i64 cy = grid_coord(grid, y0); cy <= cy1; ++cy)
+    for (i64 cx = grid_coord(grid, x0); cx <= cx1; ++cx) {
+      Grid_Cell *cell = grid_lookup(grid, cx, cy);
+      if (cell != NULL)
+        grid_cell_remove(cell, item);
+    }
+}
+
+// Add (insert = 1) or remove the item for every cell that a capsule of
+// the given radius around the segment may touch. A cell is kept when its
+// center is within radius plus half the cell diagonal of the segment.
+void grid_update_segment(Grid *grid, i64 item, f64 x0, f64 y0, f64 x1, f64 y1,
+                         f64 radius, b8 insert) {
+  f64 dx = x1 - x0;
+  f64 dy = y1 - y0;
+  f64 len2 = dx * dx + dy * dy;
+  f64 reach = radius + grid->cell_size * 0.70710678118654752;
+
+  i64 box_cx0 = grid_coord(grid, (x0 < x1 ? x0 : x1) - radius);
+  i64 cy0 = grid_coord(grid, (y0 < y1 ? y0 : y1) - radius);
+  i64 box_cx1 = grid_coord(grid, (x0 > x1 ? x0 : x1) + radius);
+  i64 cy1 = grid_coord(grid, (y0 > y1 ? y0 : y1) + radius);
+
+  for (i64 cy = cy0; cy <= cy1; ++cy) {
+    f64 py = (cy + .5) * grid->cell_size;
+
+    // Only the part of the segment within reach of the row centers can
+    // keep a cell, so scan its span in the row rather than the whole box
+    f64 t0 = 0;
+    f64 t1 = 1;
+
+    if (dy != 0) {
+      t0 = (py - reach - y0) / dy;
+      t1 = (py + reach - y0) / dy;
+      if (t0 > t1) {
+        f64 t = t0;
+        t0 = t1;
+        t1 = t;
+      }
+      if (t0 < 0)
+        t0 = 0;
+      if (t1 > 1)
+        t1 = 1;
+      if (t0 > t1)
+        continue;
+    }
+
+    f64 xa = x0 + t0 * dx;
+    f64 xb = x0 + t1 * dx;
+    i64 cx0 = grid_coord(grid, (xa < xb ? xa : xb) - reach);
+    i64 cx1 = grid_coord(grid, (xa > xb ? xa : xb) + reach);
+    if (cx0 < box_cx0)
+      cx0 = box_cx0;
+    if (cx1 > box_cx1)
+      cx1 = box_cx1;
+
+    for (i64 cx = cx0; cx <= cx1; ++cx) {
+      f64 px = (cx + .5) * grid->cell_size;
+
+      // Distance from the cell center to the closest point of the segment
+      f64 t = len2 > 0 ? ((px - x0) * dx + (py - y0) * dy) / len2 : 0;
+      if (t < 0)
+        t = 0;
+      if (t > 1)
+        t = 1;
+
+      f64 ex = x0 + t * dx - px;
+      f64 ey = y0 + t * dy - py;
+
+      if (ex * ex + ey * ey > reach * reach)
+        continue;
+
+      if (insert) {
+        grid_cell_add(grid_cell(grid, cx, cy), item);
+      } else {
+        Grid_Cell *cell = grid_lookup(grid, cx, cy);
+        if (cell != NULL)
+          grid_cell_remove(cell, item);
+      }
+    }
+  }
+}
+
+void grid_clear(Grid *grid) {
+  for (i64 i = 0; i < grid->table_size; ++i)
+    grid->cells[i].size = 0;
+}
+
+#endif